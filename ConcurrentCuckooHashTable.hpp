@@ -0,0 +1,452 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "CuckooHashTable.hpp"
+
+// Thread-safe cuckoo hash set (see Fan et al., "MemC3: Compact and Concurrent MemCache with Dumber
+// Caching and Smarter Hashing"). Writers lock the stripes covering the buckets they touch; contains()
+// takes no locks at all, instead reading a stripe's version before and after probing and retrying if
+// a writer got in between. Elements are only ever moved by copying them into their new slot before
+// clearing the old one, so a reader never misses an element that's being displaced.
+//
+// Resizing blocks writers but not readers: the new table is built from the old one (which can't
+// change while every stripe is held) and then published with a single pointer swap. Old tables are
+// kept until the set is destroyed, since a reader may still be probing one; with doubling, they
+// never add up to more than the current table.
+//
+// Readers may copy an element while a writer is overwriting it (the copy is thrown away when the
+// version check fails), so elements must be trivially copyable.
+template<typename AnyType, typename HashFamily = CuckooHashFamily<AnyType>, std::size_t BucketSize = 4>
+class ConcurrentCuckooHashTable
+{
+    static_assert(BucketSize > 0, "ConcurrentCuckooHashTable needs at least one slot per bucket");
+    static_assert(std::is_trivially_copyable<AnyType>::value,
+                  "ConcurrentCuckooHashTable reads elements optimistically, so they must be trivially copyable");
+
+public:
+    // size is the number of slots requested per table; it's rounded up to a whole (prime) number of buckets
+    explicit ConcurrentCuckooHashTable(std::size_t size = 101)
+        : stripes_(NUM_STRIPES),
+          currentSize_(0)
+    {
+        tables_.emplace_back(new Table(cuckooNextPrime((size + BucketSize - 1) / BucketSize), HashFamily()));
+        table_.store(tables_.back().get());
+    }
+
+    ConcurrentCuckooHashTable(const ConcurrentCuckooHashTable &) = delete;
+    ConcurrentCuckooHashTable & operator=(const ConcurrentCuckooHashTable &) = delete;
+
+    std::size_t size() const
+    {
+        return currentSize_.load(std::memory_order_relaxed);
+    }
+
+    bool contains(const AnyType & x) const
+    {
+        for (;;)
+        {
+            const Table * table = table_.load(std::memory_order_acquire);
+            std::size_t bucket0 = table->bucket(x, 0);
+            std::size_t bucket1 = table->bucket(x, 1);
+            const Stripe & stripe0 = stripeFor(bucket0);
+            const Stripe & stripe1 = stripeFor(bucket1);
+
+            std::uint64_t version0 = stripe0.version.load(std::memory_order_acquire);
+            std::uint64_t version1 = stripe1.version.load(std::memory_order_acquire);
+            if ((version0 | version1) & 1)
+            {
+                // A writer is part way through one of the buckets
+                std::this_thread::yield();
+                continue;
+            }
+
+            bool found = table->findInBucket(x, bucket0) != -1 || table->findInBucket(x, bucket1) != -1;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (stripe0.version.load(std::memory_order_relaxed) == version0 &&
+                stripe1.version.load(std::memory_order_relaxed) == version1 &&
+                table_.load(std::memory_order_relaxed) == table)
+                return found;
+        }
+    }
+
+    bool insert(const AnyType & x)
+    {
+        for (;;)
+        {
+            Table * table = table_.load(std::memory_order_acquire);
+            std::size_t bucket0 = table->bucket(x, 0);
+            std::size_t bucket1 = table->bucket(x, 1);
+
+            StripePairLock lock(*this, bucket0, bucket1);
+            if (table_.load(std::memory_order_relaxed) != table)
+                continue; // Resized while we were waiting for the locks
+
+            if (table->findInBucket(x, bucket0) != -1 || table->findInBucket(x, bucket1) != -1)
+                return false;
+
+            if (currentSize_.load(std::memory_order_relaxed) >= table->slots.size() * MAX_LOAD_FACTOR)
+            {
+                lock.unlock();
+                resize(table, table->tableSize * 2);
+                continue;
+            }
+
+            int freePos = table->findFreeSlot(bucket0);
+            if (freePos == -1)
+                freePos = table->findFreeSlot(bucket1);
+            if (freePos != -1)
+            {
+                writeSlot(*table, freePos, x);
+                currentSize_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+
+            // Both buckets are full. The displacement path could go through any bucket, so it's
+            // found and carried out with every stripe held
+            lock.unlock();
+            int result = insertWithEvictions(table, x);
+            if (result != -1)
+                return result == 1;
+        }
+    }
+
+    bool remove(const AnyType & x)
+    {
+        for (;;)
+        {
+            Table * table = table_.load(std::memory_order_acquire);
+            std::size_t bucket0 = table->bucket(x, 0);
+            std::size_t bucket1 = table->bucket(x, 1);
+
+            StripePairLock lock(*this, bucket0, bucket1);
+            if (table_.load(std::memory_order_relaxed) != table)
+                continue;
+
+            int pos = table->findInBucket(x, bucket0);
+            if (pos == -1)
+                pos = table->findInBucket(x, bucket1);
+            if (pos == -1)
+                return false;
+
+            Stripe & stripe = stripeFor(pos / BucketSize);
+            beginWrite(stripe);
+            table->slots[pos].isActive.store(false, std::memory_order_relaxed);
+            endWrite(stripe);
+            currentSize_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+private:
+    struct Slot
+    {
+        AnyType element;
+        std::atomic<bool> isActive;
+
+        Slot()
+            : isActive{ false } { }
+    };
+
+    struct Table
+    {
+        std::size_t tableSize; // Buckets per table
+        std::vector<Slot> slots;
+        HashFamily hashFunctions;
+
+        Table(std::size_t size, const HashFamily & hashes)
+            : tableSize(size), slots(size * 2 * BucketSize), hashFunctions(hashes) { }
+
+        // Returns the index of x's bucket in the given table; table 1's buckets follow table 0's
+        std::size_t bucket(const AnyType & x, int which) const
+        {
+            return (std::size_t)(hashFunctions.hash(x, which) % tableSize) + (which == 0 ? 0 : tableSize);
+        }
+
+        bool isActive(std::size_t pos) const
+        {
+            return slots[pos].isActive.load(std::memory_order_relaxed);
+        }
+
+        int findInBucket(const AnyType & x, std::size_t bucket) const
+        {
+            int pos = (int)(bucket * BucketSize);
+            for (std::size_t i = 0; i < BucketSize; ++i, ++pos)
+            {
+                if (!isActive(pos))
+                    continue;
+
+                // Compare a copy, so a torn read can only produce a wrong answer that the caller discards
+                AnyType element;
+                std::memcpy(&element, &slots[pos].element, sizeof(AnyType));
+                if (element == x)
+                    return pos;
+            }
+            return -1;
+        }
+
+        int findFreeSlot(std::size_t bucket) const
+        {
+            int pos = (int)(bucket * BucketSize);
+            for (std::size_t i = 0; i < BucketSize; ++i, ++pos)
+                if (!isActive(pos))
+                    return pos;
+            return -1;
+        }
+    };
+
+    // Padded so that neighbouring stripes' versions don't share a cache line
+    struct Stripe
+    {
+        std::mutex lock;
+        std::atomic<std::uint64_t> version; // Odd while a write is in progress
+        char padding[64];
+
+        Stripe()
+            : version{ 0 } { }
+    };
+
+    // Locks the (one or two) stripes covering a pair of buckets, in index order
+    class StripePairLock
+    {
+    public:
+        StripePairLock(ConcurrentCuckooHashTable & owner, std::size_t bucket0, std::size_t bucket1)
+            : first_(&owner.stripeFor(bucket0)), second_(&owner.stripeFor(bucket1)), locked_(true)
+        {
+            if (first_ > second_)
+                std::swap(first_, second_);
+            first_->lock.lock();
+            if (second_ != first_)
+                second_->lock.lock();
+        }
+
+        ~StripePairLock()
+        {
+            unlock();
+        }
+
+        void unlock()
+        {
+            if (!locked_)
+                return;
+            if (second_ != first_)
+                second_->lock.unlock();
+            first_->lock.unlock();
+            locked_ = false;
+        }
+
+    private:
+        Stripe * first_;
+        Stripe * second_;
+        bool locked_;
+    };
+
+    // One step of a displacement path: the element in slot moves to the next step's slot
+    struct PathStep
+    {
+        std::size_t bucket;
+        int slot;
+        int parent; // Index of the previous step in the search queue
+    };
+
+    Stripe & stripeFor(std::size_t bucket)
+    {
+        return stripes_[bucket % NUM_STRIPES];
+    }
+
+    const Stripe & stripeFor(std::size_t bucket) const
+    {
+        return stripes_[bucket % NUM_STRIPES];
+    }
+
+    static void beginWrite(Stripe & stripe)
+    {
+        stripe.version.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void endWrite(Stripe & stripe)
+    {
+        stripe.version.fetch_add(1, std::memory_order_release);
+    }
+
+    void writeSlot(Table & table, int pos, const AnyType & x)
+    {
+        Stripe & stripe = stripeFor(pos / BucketSize);
+        beginWrite(stripe);
+        table.slots[pos].element = x;
+        table.slots[pos].isActive.store(true, std::memory_order_relaxed);
+        endWrite(stripe);
+    }
+
+    void lockAll()
+    {
+        for (auto & stripe : stripes_)
+            stripe.lock.lock();
+    }
+
+    void unlockAll()
+    {
+        for (auto it = stripes_.rbegin(); it != stripes_.rend(); ++it)
+            it->lock.unlock();
+    }
+
+    // Returns 1 if x was inserted, 0 if it was already present and -1 if the caller should retry
+    int insertWithEvictions(Table * table, const AnyType & x)
+    {
+        lockAll();
+        if (table_.load(std::memory_order_relaxed) != table)
+        {
+            unlockAll();
+            return -1;
+        }
+
+        // Another writer may have inserted x or made room since we looked
+        std::size_t bucket0 = table->bucket(x, 0);
+        std::size_t bucket1 = table->bucket(x, 1);
+        if (table->findInBucket(x, bucket0) != -1 || table->findInBucket(x, bucket1) != -1)
+        {
+            unlockAll();
+            return 0;
+        }
+
+        bool inserted = placeElement(*table, x, true);
+        unlockAll();
+
+        if (!inserted)
+        {
+            resize(table, table->tableSize * 2);
+            return -1;
+        }
+        currentSize_.fetch_add(1, std::memory_order_relaxed);
+        return 1;
+    }
+
+    // Places x in table, displacing other elements along the shortest path to a free slot. Every
+    // bucket that's touched must be locked (or the table not yet published). Returns false if no
+    // path was found within the search limit, leaving the table unchanged
+    bool placeElement(Table & table, const AnyType & x, bool published)
+    {
+        const int MAX_PATH_NODES = 256;
+        PathStep queue[MAX_PATH_NODES];
+        int head = 0;
+        int tail = 0;
+        int found = -1;
+        int freePos = -1;
+
+        queue[tail++] = PathStep{ table.bucket(x, 0), -1, -1 };
+        queue[tail++] = PathStep{ table.bucket(x, 1), -1, -1 };
+
+        // Breadth-first search for the nearest bucket with a free slot
+        while (head < tail && found == -1)
+        {
+            int current = head++;
+            freePos = table.findFreeSlot(queue[current].bucket);
+            if (freePos != -1)
+            {
+                found = current;
+                break;
+            }
+
+            std::size_t firstSlot = queue[current].bucket * BucketSize;
+            for (std::size_t i = 0; i < BucketSize && tail < MAX_PATH_NODES; ++i)
+            {
+                const AnyType & occupant = table.slots[firstSlot + i].element;
+                std::size_t bucket0 = table.bucket(occupant, 0);
+                std::size_t alternate = bucket0 == queue[current].bucket ? table.bucket(occupant, 1) : bucket0;
+
+                // Don't revisit a bucket that's already on this path
+                bool onPath = false;
+                for (int step = current; step != -1 && !onPath; step = queue[step].parent)
+                    onPath = queue[step].bucket == alternate;
+                if (!onPath)
+                    queue[tail++] = PathStep{ alternate, (int)(firstSlot + i), current };
+            }
+        }
+
+        if (found == -1)
+            return false;
+
+        // Work back from the free slot, copying each element forward before its old slot is reused
+        for (int step = found; queue[step].parent != -1; step = queue[step].parent)
+        {
+            int from = queue[step].slot;
+            moveSlot(table, from, freePos, published);
+            freePos = from;
+        }
+
+        if (published)
+            writeSlot(table, freePos, x);
+        else
+        {
+            table.slots[freePos].element = x;
+            table.slots[freePos].isActive.store(true, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void moveSlot(Table & table, int from, int to, bool published)
+    {
+        if (!published)
+        {
+            table.slots[to].element = table.slots[from].element;
+            table.slots[to].isActive.store(true, std::memory_order_relaxed);
+            table.slots[from].isActive.store(false, std::memory_order_relaxed);
+            return;
+        }
+
+        // The element's two buckets are exactly from's and to's, so a reader looking for it has
+        // both stripes' versions and will retry if it overlaps either write
+        writeSlot(table, to, table.slots[from].element);
+
+        Stripe & stripe = stripeFor(from / BucketSize);
+        beginWrite(stripe);
+        table.slots[from].isActive.store(false, std::memory_order_relaxed);
+        endWrite(stripe);
+    }
+
+    // Replaces table (if it's still current) with one of newSize buckets per table
+    void resize(Table * table, std::size_t newSize)
+    {
+        std::lock_guard<std::mutex> resizeLock(resizeMutex_);
+        if (table_.load(std::memory_order_relaxed) != table)
+            return; // Someone else got there first
+
+        // Writers wait until the new table is published; readers carry on with the old one
+        lockAll();
+        HashFamily hashes = table->hashFunctions;
+        std::unique_ptr<Table> newTable;
+        bool built = false;
+        while (!built)
+        {
+            newTable.reset(new Table(cuckooNextPrime(newSize), hashes));
+            built = true;
+            for (std::size_t pos = 0; pos < table->slots.size() && built; ++pos)
+                if (table->isActive(pos))
+                    built = placeElement(*newTable, table->slots[pos].element, false);
+
+            // Unlucky hash functions; try again with new ones
+            if (!built)
+                hashes.regenerate();
+        }
+
+        table_.store(newTable.get(), std::memory_order_release);
+        tables_.push_back(std::move(newTable));
+        unlockAll();
+    }
+
+    static constexpr double MAX_LOAD_FACTOR = cuckooMaxLoad(BucketSize);
+    static const std::size_t NUM_STRIPES = 128;
+    std::vector<Stripe> stripes_;
+    std::atomic<Table *> table_;
+    std::vector<std::unique_ptr<Table>> tables_; // Current and retired tables; guarded by resizeMutex_
+    std::mutex resizeMutex_;
+    std::atomic<std::size_t> currentSize_;
+};
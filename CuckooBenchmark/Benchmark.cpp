@@ -0,0 +1,53 @@
+#include <cstdlib>
+#include <sstream>
+#include "Benchmark.h"
+
+volatile std::size_t benchSink;
+
+double secondsBetween(BenchClock::time_point start, BenchClock::time_point end)
+{
+    return std::chrono::duration<double>(end - start).count();
+}
+
+double clockOverheadNanoseconds()
+{
+    std::vector<double> samples(10000);
+    for (std::size_t i = 0; i < samples.size(); ++i)
+    {
+        BenchClock::time_point start = BenchClock::now();
+        BenchClock::time_point end = BenchClock::now();
+        samples[i] = secondsBetween(start, end) * 1e9;
+    }
+    return summarize(samples).p50;
+}
+
+LatencySummary summarize(std::vector<double> & latencies)
+{
+    LatencySummary summary = { 0, 0, 0, 0 };
+    if (latencies.empty())
+        return summary;
+
+    std::sort(latencies.begin(), latencies.end());
+    std::size_t last = latencies.size() - 1;
+    summary.p50 = latencies[last / 2];
+    summary.p99 = latencies[(std::size_t)(last * 0.99)];
+    summary.p999 = latencies[(std::size_t)(last * 0.999)];
+    summary.max = latencies[last];
+    return summary;
+}
+
+bool parseList(const std::string & text, std::vector<double> & values)
+{
+    values.clear();
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+        char * end;
+        double value = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0')
+            return false;
+        values.push_back(value);
+    }
+    return !values.empty();
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "CuckooHashTable.hpp"
+
+typedef std::chrono::steady_clock BenchClock;
+
+// SimpleStruct-style key of Bytes bytes. Only the first 8 bytes are needed to tell keys apart; the
+// rest is filled in from them, so that hashing and comparing a key touches all of it
+template <std::size_t Bytes>
+struct BenchKey
+{
+    static_assert(Bytes >= 4 && Bytes % 4 == 0, "BenchKey sizes are whole numbers of 32-bit words");
+
+    std::uint32_t words[Bytes / 4];
+
+    bool operator==(const BenchKey & rhs) const
+    {
+        return std::memcmp(words, rhs.words, sizeof(words)) == 0;
+    }
+};
+
+// The key with the given id; 4-byte keys only hold the low 32 bits of it
+template <std::size_t Bytes>
+BenchKey<Bytes> makeKey(std::uint64_t id)
+{
+    BenchKey<Bytes> key;
+    key.words[0] = (std::uint32_t)id;
+    for (std::size_t i = 1; i < Bytes / 4; ++i)
+        key.words[i] = i == 1 ? (std::uint32_t)(id >> 32) : (std::uint32_t)(id * (2 * i + 1));
+    return key;
+}
+
+// Hashes a key with CuckooHashFamily's first hash function, so the tables being compared all pay
+// the same for hashing: the CuckooFixedHasher mixer for 4, 8 and 16-byte keys, MurmurHash64 otherwise
+template <typename Key>
+struct BenchHasher
+{
+    std::size_t operator()(const Key & key) const
+    {
+        return (std::size_t)hashes_.hash(key, 0);
+    }
+
+private:
+    CuckooHashFamily<Key> hashes_;
+};
+
+// Sink for results that the compiler would otherwise be free to throw away along with the work
+extern volatile std::size_t benchSink;
+
+double secondsBetween(BenchClock::time_point start, BenchClock::time_point end);
+
+// Cost of reading the clock, which is included in every individually timed operation
+double clockOverheadNanoseconds();
+
+// Latency percentiles, in nanoseconds, of a set of individually timed operations
+struct LatencySummary
+{
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+// Sorts latencies
+LatencySummary summarize(std::vector<double> & latencies);
+
+// Parses a comma-separated list of numbers, e.g. "4,8,16"; returns false if it isn't one
+bool parseList(const std::string & text, std::vector<double> & values);
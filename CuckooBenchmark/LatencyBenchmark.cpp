@@ -0,0 +1,153 @@
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <vector>
+#include "CuckooHashTable.hpp"
+#include "CuckooStats.hpp"
+#include "Benchmark.h"
+#include "LatencyBenchmark.h"
+#include "LatencyHistogram.h"
+
+namespace
+{
+    typedef BenchKey<8> Key;
+    typedef CuckooHashTable<Key, CuckooHashFamily<Key>, 4, 2, CuckooIdentityKey, PrimeSizePolicy,
+                            std::allocator<Key>, CuckooStats> Table;
+
+    // What an insertion had to do besides writing the element, going by the table's statistics.
+    // An insertion that did several things counts as the last one listed
+    enum InsertKind
+    {
+        PLAIN,   // Found a free slot straight away
+        EVICT,   // Moved other elements to make room
+        STASH,   // Couldn't make room and went to the stash
+        REHASH,  // Rebuilt the table with new hash functions
+        GROW,    // Started growing the table
+        KIND_COUNT
+    };
+
+    const char * const KIND_NAMES[KIND_COUNT] = { "plain", "evict", "stash", "rehash", "grow" };
+
+    // An insertion worth listing: one that resized or rehashed, or one of the slowest
+    struct InsertEvent
+    {
+        std::size_t index;     // How many insertions came before it
+        std::uint64_t nanoseconds;
+        InsertKind kind;
+        std::size_t capacity;  // Capacity after the insertion
+
+        bool operator>(const InsertEvent & rhs) const
+        {
+            return nanoseconds > rhs.nanoseconds;
+        }
+    };
+
+    InsertKind kindOf(const CuckooStats & before, const CuckooStats & after)
+    {
+        if (after.grows != before.grows)
+            return GROW;
+        if (after.rehashes != before.rehashes)
+            return REHASH;
+        if (after.stashInserts != before.stashInserts)
+            return STASH;
+        if (after.evictions != before.evictions)
+            return EVICT;
+        return PLAIN;
+    }
+
+    void printPercentiles(const char * name, const LatencyHistogram & histogram)
+    {
+        std::cout << std::left << std::setw(8) << name << std::right << std::setw(12) << histogram.count();
+        if (histogram.count() == 0)
+        {
+            std::cout << std::endl;
+            return;
+        }
+
+        std::cout << std::setw(10) << histogram.percentile(0.5) << std::setw(10) << histogram.percentile(0.99)
+                  << std::setw(10) << histogram.percentile(0.999) << std::setw(10) << histogram.percentile(0.9999)
+                  << std::setw(14) << histogram.max() << std::endl;
+    }
+
+    void printEvent(const InsertEvent & event)
+    {
+        std::cout << std::setw(12) << event.index << std::setw(14) << event.nanoseconds << "  " << std::left
+                  << std::setw(8) << KIND_NAMES[event.kind] << std::right << std::setw(12) << event.capacity << std::endl;
+    }
+}
+
+void runLatencyBenchmark(const LatencyOptions & options)
+{
+    Table table(options.initialSize);
+    table.setIncrementalResize(options.incremental);
+    LatencyHistogram all;
+    LatencyHistogram byKind[KIND_COUNT];
+    std::vector<InsertEvent> resizes;
+
+    // Min-heap of the slowest insertions so far, so the fastest of them is the one to replace
+    std::priority_queue<InsertEvent, std::vector<InsertEvent>, std::greater<InsertEvent>> slowest;
+
+    BenchClock::time_point begin = BenchClock::now();
+    for (std::size_t i = 0; i < options.elements; ++i)
+    {
+        Key key = makeKey<8>(i);
+        CuckooStats before = table.stats();
+
+        BenchClock::time_point start = BenchClock::now();
+        table.insert(key);
+        std::uint64_t nanoseconds = (std::uint64_t)(secondsBetween(start, BenchClock::now()) * 1e9);
+
+        InsertKind kind = kindOf(before, table.stats());
+        all.record(nanoseconds);
+        byKind[kind].record(nanoseconds);
+
+        InsertEvent event = { i, nanoseconds, kind, 0 };
+        if (kind == GROW || kind == REHASH)
+        {
+            event.capacity = table.capacity();
+            resizes.push_back(event);
+        }
+        if (slowest.size() < options.slowest || (!slowest.empty() && nanoseconds > slowest.top().nanoseconds))
+        {
+            event.capacity = table.capacity();
+            slowest.push(event);
+            if (slowest.size() > options.slowest)
+                slowest.pop();
+        }
+    }
+    double seconds = secondsBetween(begin, BenchClock::now());
+
+    std::cout << "Inserted " << options.elements << " 8-byte keys into a CuckooHashTable of initial size "
+              << options.initialSize << (options.incremental ? " with incremental resizing" : "") << " in "
+              << seconds << " s; capacity is now " << table.capacity() << std::endl;
+    std::cout << "Latencies are in ns and include about " << (int)clockOverheadNanoseconds()
+              << " ns of reading the clock" << std::endl << std::endl;
+
+    std::cout << "kind           count       p50       p99     p99.9    p99.99           max" << std::endl;
+    printPercentiles("all", all);
+    for (int kind = 0; kind < KIND_COUNT; ++kind)
+        printPercentiles(KIND_NAMES[kind], byKind[kind]);
+
+    std::cout << std::endl << "Resizes and rehashes:" << std::endl;
+    std::cout << "   insertion       latency  kind        capacity" << std::endl;
+    for (const InsertEvent & event : resizes)
+        printEvent(event);
+
+    std::vector<InsertEvent> slowestFirst;
+    for (; !slowest.empty(); slowest.pop())
+        slowestFirst.push_back(slowest.top());
+
+    std::cout << std::endl << "Slowest " << slowestFirst.size() << " insertions:" << std::endl;
+    std::cout << "   insertion       latency  kind        capacity" << std::endl;
+    for (std::size_t i = slowestFirst.size(); i-- > 0; )
+        printEvent(slowestFirst[i]);
+
+    if (options.distribution)
+    {
+        std::cout << std::endl << "Distribution of all insertions:" << std::endl;
+        all.writeDistribution(std::cout);
+    }
+
+    std::cout << std::endl << "Table statistics: " << table.statsJson() << std::endl;
+}
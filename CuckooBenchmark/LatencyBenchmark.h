@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+
+struct LatencyOptions
+{
+    std::size_t elements;     // Number of elements to grow the table to
+    std::size_t initialSize;  // Size the table is constructed with
+    std::size_t slowest;      // Number of slowest insertions to list
+    bool incremental;         // Grow the table with CuckooHashTable::setIncrementalResize(true)
+    bool distribution;        // Also print the full percentile distribution of all insertions
+};
+
+// Grows a CuckooHashTable of 8-byte keys from initialSize to the given number of elements, timing
+// every insertion. Prints latency percentiles for all insertions and separately for the ones that
+// started a resize or a rehash, then every resize and rehash, then the slowest insertions and what
+// they triggered
+void runLatencyBenchmark(const LatencyOptions & options);
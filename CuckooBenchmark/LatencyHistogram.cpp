@@ -0,0 +1,61 @@
+#include <cmath>
+#include <iomanip>
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+    : counts_(indexOf(~0ull) + 1, 0),
+      count_(0),
+      max_(0)
+{
+}
+
+std::uint64_t LatencyHistogram::percentile(double fraction) const
+{
+    if (count_ == 0)
+        return 0;
+
+    std::uint64_t target = (std::uint64_t)std::ceil(fraction * count_);
+    if (target == 0)
+        target = 1;
+
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts_.size(); ++i)
+    {
+        seen += counts_[i];
+        if (seen >= target)
+            return highestValueAt(i) < max_ ? highestValueAt(i) : max_;
+    }
+    return max_;
+}
+
+void LatencyHistogram::writeDistribution(std::ostream & out) const
+{
+    out << std::setw(12) << "value_ns" << std::setw(16) << "percentile" << std::setw(14) << "count" << std::endl;
+
+    // Halve the distance to 100% each step, with a few points per halving, down to where a single
+    // operation makes the difference
+    for (double remaining = 1; ; remaining /= 2)
+    {
+        for (int step = 0; step < 4; ++step)
+        {
+            double fraction = 1 - remaining * (1 - step / 8.0);
+            out << std::setw(12) << percentile(fraction) << std::setw(16) << std::fixed << std::setprecision(10)
+                << fraction << std::setw(14) << (std::uint64_t)(fraction * count_) << std::endl;
+        }
+
+        if (remaining * count_ < 1)
+            break;
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setw(12) << max_ << std::setw(16) << "1.0000000000" << std::setw(14) << count_ << std::endl;
+}
+
+std::uint64_t LatencyHistogram::highestValueAt(std::size_t index)
+{
+    if (index < EXACT_LIMIT)
+        return index;
+
+    std::uint64_t shift = (index - EXACT_LIMIT) / (1ull << SUB_BUCKET_BITS) + 1;
+    std::uint64_t subBucket = (index - EXACT_LIMIT) % (1ull << SUB_BUCKET_BITS) + (1ull << SUB_BUCKET_BITS);
+    return ((subBucket + 1) << shift) - 1;
+}
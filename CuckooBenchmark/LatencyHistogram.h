@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Histogram of latencies in nanoseconds in the style of HdrHistogram: values below 128 are counted
+// exactly, and every power of two above that is split into 64 equal sub-buckets, so any recorded
+// value is known to within 1/64 (about 1.6%) however large it is. That keeps recording to an
+// increment, and memory to a few thousand counters, for any number of operations
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(std::uint64_t nanoseconds)
+    {
+        ++counts_[indexOf(nanoseconds)];
+        ++count_;
+        if (nanoseconds > max_)
+            max_ = nanoseconds;
+    }
+
+    std::uint64_t count() const
+    {
+        return count_;
+    }
+
+    std::uint64_t max() const
+    {
+        return max_;
+    }
+
+    // Smallest recorded value that at least fraction of the recorded values are no greater than,
+    // rounded up to the top of its sub-bucket (but never past the maximum)
+    std::uint64_t percentile(double fraction) const;
+
+    // Prints the values at increasingly fine percentiles, one "value percentile count" line each,
+    // like HdrHistogram's percentile distribution output
+    void writeDistribution(std::ostream & out) const;
+
+private:
+    static const unsigned SUB_BUCKET_BITS = 6;
+    static const std::uint64_t EXACT_LIMIT = 2ull << SUB_BUCKET_BITS;
+
+    static unsigned highestBit(std::uint64_t value)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return (unsigned)index;
+#elif defined(__GNUC__)
+        return 63 - (unsigned)__builtin_clzll(value);
+#else
+        unsigned index = 0;
+        while (value >>= 1)
+            ++index;
+        return index;
+#endif
+    }
+
+    static std::size_t indexOf(std::uint64_t value)
+    {
+        if (value < EXACT_LIMIT)
+            return (std::size_t)value;
+
+        // Keep the top SUB_BUCKET_BITS + 1 bits of the value; the leading one picks the power of two
+        unsigned shift = highestBit(value) - SUB_BUCKET_BITS;
+        std::uint64_t subBucket = (value >> shift) - (1ull << SUB_BUCKET_BITS);
+        return (std::size_t)(EXACT_LIMIT + (shift - 1) * (1ull << SUB_BUCKET_BITS) + subBucket);
+    }
+
+    // Largest value counted in the given index
+    static std::uint64_t highestValueAt(std::size_t index);
+
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t count_;
+    std::uint64_t max_;
+};
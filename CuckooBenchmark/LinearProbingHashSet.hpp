@@ -0,0 +1,138 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Textbook open addressing with linear probing, as a baseline for CuckooHashTable. Removed slots
+// become tombstones, which lookups probe past and insertions reuse. Once live elements and
+// tombstones together pass maxLoad, the table is rebuilt without the tombstones, at twice the size
+// if they were mostly live elements
+template <typename AnyType, typename Hash>
+class LinearProbingHashSet
+{
+public:
+    explicit LinearProbingHashSet(std::size_t capacity, double maxLoad = 0.5)
+        : maxLoad_(maxLoad),
+          currentSize_(0),
+          used_(0)
+    {
+        allocate(capacity < 8 ? 8 : capacity);
+    }
+
+    std::size_t size() const
+    {
+        return currentSize_;
+    }
+
+    bool contains(const AnyType & x) const
+    {
+        std::size_t pos = home(x);
+        while (state_[pos] != EMPTY)
+        {
+            if (state_[pos] == FULL && slots_[pos] == x)
+                return true;
+            pos = next(pos);
+        }
+        return false;
+    }
+
+    bool insert(const AnyType & x)
+    {
+        if (used_ + 1 > maxUsed_)
+            rehash(currentSize_ + 1 > maxUsed_ / 2 ? slots_.size() * 2 : slots_.size());
+
+        std::size_t pos = home(x);
+        std::size_t tombstone = NONE;
+        while (state_[pos] != EMPTY)
+        {
+            if (state_[pos] == FULL)
+            {
+                if (slots_[pos] == x)
+                    return false;
+            }
+            else if (tombstone == NONE)
+            {
+                tombstone = pos;
+            }
+            pos = next(pos);
+        }
+
+        if (tombstone != NONE)
+            pos = tombstone;
+        else
+            ++used_;
+        slots_[pos] = x;
+        state_[pos] = FULL;
+        ++currentSize_;
+        return true;
+    }
+
+    bool remove(const AnyType & x)
+    {
+        std::size_t pos = home(x);
+        while (state_[pos] != EMPTY)
+        {
+            if (state_[pos] == FULL && slots_[pos] == x)
+            {
+                state_[pos] = DELETED;
+                --currentSize_;
+                return true;
+            }
+            pos = next(pos);
+        }
+        return false;
+    }
+
+private:
+    // Maps the hash onto [0, capacity) with a multiply and shift rather than a division
+    std::size_t home(const AnyType & x) const
+    {
+        std::uint64_t hash = (std::uint32_t)hash_(x);
+        return (std::size_t)((hash * slots_.size()) >> 32);
+    }
+
+    std::size_t next(std::size_t pos) const
+    {
+        return pos + 1 == slots_.size() ? 0 : pos + 1;
+    }
+
+    void allocate(std::size_t capacity)
+    {
+        slots_.assign(capacity, AnyType());
+        state_.assign(capacity, EMPTY);
+        maxUsed_ = (std::size_t)(capacity * maxLoad_);
+        currentSize_ = 0;
+        used_ = 0;
+    }
+
+    // Moves every live element into a table of the given capacity, dropping the tombstones
+    void rehash(std::size_t capacity)
+    {
+        std::vector<AnyType> oldSlots;
+        std::vector<std::uint8_t> oldState;
+        oldSlots.swap(slots_);
+        oldState.swap(state_);
+
+        allocate(capacity);
+        for (std::size_t i = 0; i < oldSlots.size(); ++i)
+            if (oldState[i] == FULL)
+                insert(std::move(oldSlots[i]));
+    }
+
+    enum SlotState : std::uint8_t
+    {
+        EMPTY,
+        FULL,
+        DELETED
+    };
+
+    static const std::size_t NONE = (std::size_t)-1;
+    std::vector<AnyType> slots_;
+    std::vector<std::uint8_t> state_;
+    double maxLoad_;
+    std::size_t maxUsed_;     // Live elements plus tombstones allowed before the table grows
+    std::size_t currentSize_;
+    std::size_t used_;        // Live elements plus tombstones
+    Hash hash_;
+};
@@ -0,0 +1,134 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "Benchmark.h"
+#include "LatencyBenchmark.h"
+#include "ThroughputBenchmark.h"
+
+namespace
+{
+    void usage(const char * program)
+    {
+        std::cerr << "Usage: " << program << " [options]\n"
+                  << "Throughput of CuckooHashTable, std::unordered_set and linear probing:\n"
+                  << "  --keys=4,8,...      Key sizes in bytes (4 to 256; default all)\n"
+                  << "  --elements=N,...    Element counts (default 1024,32768,1048576,16777216)\n"
+                  << "  --loads=F,...       Load factors each table is sized for (default 0.5,0.85)\n"
+                  << "  --samples=N         Operations timed individually per workload (default 100000)\n"
+                  << "  --max-mb=N          Skip configurations with more than N MB of keys (default 256)\n"
+                  << "  --quick             Small sizes only: --keys=8,64 --elements=1024,32768 --loads=0.85\n"
+                  << "  --csv               Print CSV instead of a table\n"
+                  << "Insertion latency while growing a CuckooHashTable:\n"
+                  << "  --latency           Run this benchmark instead\n"
+                  << "  --grow-to=N         Elements to insert (default 20000000)\n"
+                  << "  --initial-size=N    Size the table starts at (default 101)\n"
+                  << "  --slowest=N         Slowest insertions to list (default 20)\n"
+                  << "  --incremental       Resize incrementally (CuckooHashTable::setIncrementalResize)\n"
+                  << "  --distribution      Print the full latency distribution" << std::endl;
+    }
+
+    // Matches --name=value, setting value to what follows the '='
+    bool option(const char * arg, const char * name, std::string & value)
+    {
+        std::size_t length = std::strlen(name);
+        if (std::strncmp(arg, name, length) != 0 || arg[length] != '=')
+            return false;
+
+        value = arg + length + 1;
+        return true;
+    }
+
+    template <typename T>
+    bool parseOption(const std::string & text, std::vector<T> & values)
+    {
+        std::vector<double> numbers;
+        if (!parseList(text, numbers))
+            return false;
+
+        values.assign(numbers.begin(), numbers.end());
+        return true;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    ThroughputOptions options;
+    options.keySizes = { 4, 8, 16, 32, 64, 128, 256 };
+    options.elementCounts = { 1 << 10, 1 << 15, 1 << 20, 1 << 24 };
+    options.loadFactors = { 0.5, 0.85 };
+    options.latencySamples = 100000;
+    options.maxKeyMegabytes = 256;
+    options.csv = false;
+
+    bool latency = false;
+    LatencyOptions latencyOptions;
+    latencyOptions.elements = 20000000;
+    latencyOptions.initialSize = 101;
+    latencyOptions.slowest = 20;
+    latencyOptions.incremental = false;
+    latencyOptions.distribution = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string value;
+        std::vector<std::size_t> number;
+        bool ok = true;
+
+        if (option(argv[i], "--keys", value))
+            ok = parseOption(value, options.keySizes);
+        else if (option(argv[i], "--elements", value))
+            ok = parseOption(value, options.elementCounts);
+        else if (option(argv[i], "--loads", value))
+            ok = parseOption(value, options.loadFactors);
+        else if (option(argv[i], "--samples", value))
+            ok = parseOption(value, number) && number.size() == 1 && (options.latencySamples = number[0]) > 0;
+        else if (option(argv[i], "--max-mb", value))
+            ok = parseOption(value, number) && number.size() == 1 && (options.maxKeyMegabytes = number[0]) > 0;
+        else if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            options.keySizes = { 8, 64 };
+            options.elementCounts = { 1 << 10, 1 << 15 };
+            options.loadFactors = { 0.85 };
+        }
+        else if (std::strcmp(argv[i], "--csv") == 0)
+            options.csv = true;
+        else if (std::strcmp(argv[i], "--latency") == 0)
+            latency = true;
+        else if (option(argv[i], "--grow-to", value))
+            ok = parseOption(value, number) && number.size() == 1 && (latencyOptions.elements = number[0]) > 0;
+        else if (option(argv[i], "--initial-size", value))
+            ok = parseOption(value, number) && number.size() == 1 && (latencyOptions.initialSize = number[0]) > 0;
+        else if (option(argv[i], "--slowest", value))
+            ok = parseOption(value, number) && number.size() == 1 && ((latencyOptions.slowest = number[0]), true);
+        else if (std::strcmp(argv[i], "--incremental") == 0)
+            latencyOptions.incremental = true;
+        else if (std::strcmp(argv[i], "--distribution") == 0)
+            latencyOptions.distribution = true;
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (latency)
+    {
+        runLatencyBenchmark(latencyOptions);
+        return 0;
+    }
+
+    for (double loadFactor : options.loadFactors)
+    {
+        if (loadFactor <= 0 || loadFactor >= 1)
+        {
+            std::cerr << "Load factors must be between 0 and 1" << std::endl;
+            return 1;
+        }
+    }
+
+    runThroughputBenchmarks(options);
+    return 0;
+}
@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <unordered_set>
+#include "CuckooHashTable.hpp"
+#include "Benchmark.h"
+#include "LinearProbingHashSet.hpp"
+#include "ThroughputBenchmark.h"
+
+namespace
+{
+    // Measurements on small tables repeat the workload until at least this many operations have run,
+    // so the clock's resolution doesn't matter
+    const std::size_t MIN_OPS = 1 << 20;
+
+    // The tables being compared, behind a common interface. Each one is sized up front for the
+    // configuration's element count at its load factor, so filling it shouldn't trigger a resize
+    // unless the load factor is higher than the table allows
+    template <typename Key>
+    class CuckooSet
+    {
+    public:
+        static const char * name()
+        {
+            return "CuckooHashTable";
+        }
+
+        // The table's size is per table, and it has two
+        CuckooSet(std::size_t elements, double loadFactor)
+            : table_((std::size_t)(elements / loadFactor / 2) + 1)
+        {
+        }
+
+        bool insert(const Key & key)
+        {
+            return table_.insert(key);
+        }
+
+        bool contains(const Key & key) const
+        {
+            return table_.contains(key);
+        }
+
+        bool remove(const Key & key)
+        {
+            return table_.remove(key);
+        }
+
+    private:
+        CuckooHashTable<Key> table_;
+    };
+
+    template <typename Key>
+    class StdSet
+    {
+    public:
+        static const char * name()
+        {
+            return "std::unordered_set";
+        }
+
+        StdSet(std::size_t elements, double loadFactor)
+        {
+            set_.max_load_factor((float)loadFactor);
+            set_.reserve(elements);
+        }
+
+        bool insert(const Key & key)
+        {
+            return set_.insert(key).second;
+        }
+
+        bool contains(const Key & key) const
+        {
+            return set_.find(key) != set_.end();
+        }
+
+        bool remove(const Key & key)
+        {
+            return set_.erase(key) != 0;
+        }
+
+    private:
+        std::unordered_set<Key, BenchHasher<Key>> set_;
+    };
+
+    template <typename Key>
+    class LinearSet
+    {
+    public:
+        static const char * name()
+        {
+            return "LinearProbingHashSet";
+        }
+
+        LinearSet(std::size_t elements, double loadFactor)
+            : set_((std::size_t)(elements / loadFactor) + 1, std::min(loadFactor, 0.95))
+        {
+        }
+
+        bool insert(const Key & key)
+        {
+            return set_.insert(key);
+        }
+
+        bool contains(const Key & key) const
+        {
+            return set_.contains(key);
+        }
+
+        bool remove(const Key & key)
+        {
+            return set_.remove(key);
+        }
+
+    private:
+        LinearProbingHashSet<Key, BenchHasher<Key>> set_;
+    };
+
+    // Keys for one element count
+    template <typename Key>
+    struct Workload
+    {
+        std::size_t elements;
+        double loadFactor;
+        std::vector<Key> keys;              // What the table is filled with, in insertion order
+        std::vector<Key> lookups;           // The same keys, shuffled
+        std::vector<Key> misses;            // Keys that are never inserted
+        std::vector<Key> newKeys;           // Keys the mixed workload inserts
+        std::vector<std::uint32_t> offsets; // Random offsets the mixed workload picks lookups with
+
+        // Key id for ids below elements, newKeys[id - elements] above
+        const Key & liveKey(std::size_t id) const
+        {
+            return id < elements ? keys[id] : newKeys[id - elements];
+        }
+    };
+
+    template <typename Key>
+    void makeWorkload(Workload<Key> & w, std::size_t elements)
+    {
+        static const std::size_t Bytes = sizeof(Key);
+        std::mt19937_64 random(elements);
+
+        w.elements = elements;
+        w.keys.resize(elements);
+        w.newKeys.resize(elements / 4 + 1);
+        w.misses.resize(elements);
+        w.offsets.resize(elements);
+        for (std::size_t i = 0; i < elements; ++i)
+        {
+            w.keys[i] = makeKey<Bytes>(i);
+            w.misses[i] = makeKey<Bytes>(elements + w.newKeys.size() + i);
+            w.offsets[i] = (std::uint32_t)random();
+        }
+        for (std::size_t i = 0; i < w.newKeys.size(); ++i)
+            w.newKeys[i] = makeKey<Bytes>(elements + i);
+
+        w.lookups = w.keys;
+        std::shuffle(w.lookups.begin(), w.lookups.end(), random);
+    }
+
+    struct Measurement
+    {
+        double opsPerSecond;
+        LatencySummary latency;
+    };
+
+    // Runs ops operations op(set, i) on a table that prepare has set up, first all together to
+    // get the throughput, then in a separate pass that times a sample of them one at a time, so
+    // that reading the clock doesn't slow down the throughput measurement
+    template <typename Set, typename Key, typename Prepare, typename Op>
+    Measurement measure(const Workload<Key> & w, std::size_t ops, std::size_t samples, Prepare prepare, Op op)
+    {
+        std::size_t results = 0;
+        std::size_t rounds = std::max<std::size_t>(1, MIN_OPS / ops);
+        double seconds = 0;
+        for (std::size_t round = 0; round < rounds; ++round)
+        {
+            Set set(w.elements, w.loadFactor);
+            prepare(set);
+
+            BenchClock::time_point start = BenchClock::now();
+            for (std::size_t i = 0; i < ops; ++i)
+                results += op(set, i);
+            seconds += secondsBetween(start, BenchClock::now());
+        }
+
+        std::vector<double> latencies;
+        std::size_t stride = std::max<std::size_t>(1, ops / samples);
+        std::size_t latencyRounds = std::max<std::size_t>(1, samples / ops);
+        latencies.reserve(latencyRounds * (ops / stride + 1));
+        for (std::size_t round = 0; round < latencyRounds; ++round)
+        {
+            Set set(w.elements, w.loadFactor);
+            prepare(set);
+
+            for (std::size_t i = 0; i < ops; ++i)
+            {
+                if (i % stride != 0)
+                {
+                    results += op(set, i);
+                    continue;
+                }
+
+                BenchClock::time_point start = BenchClock::now();
+                results += op(set, i);
+                latencies.push_back(secondsBetween(start, BenchClock::now()) * 1e9);
+            }
+        }
+
+        benchSink = results;
+        Measurement measurement = { rounds * ops / seconds, summarize(latencies) };
+        return measurement;
+    }
+
+    void report(const ThroughputOptions & options, std::size_t keyBytes, std::size_t elements, double loadFactor,
+                const char * table, const char * workload, const Measurement & m)
+    {
+        if (options.csv)
+        {
+            std::cout << keyBytes << ',' << elements << ',' << loadFactor << ',' << table << ',' << workload << ','
+                      << m.opsPerSecond / 1e6 << ',' << m.latency.p50 << ',' << m.latency.p99 << ','
+                      << m.latency.p999 << ',' << m.latency.max << std::endl;
+            return;
+        }
+
+        std::cout << std::setw(5) << keyBytes << std::setw(10) << elements << std::setw(6) << loadFactor << "  "
+                  << std::left << std::setw(22) << table << std::setw(9) << workload << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(10) << m.opsPerSecond / 1e6
+                  << std::setprecision(0) << std::setw(9) << m.latency.p50 << std::setw(9) << m.latency.p99
+                  << std::setw(9) << m.latency.p999 << std::setw(11) << m.latency.max << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+
+    template <typename Set, typename Key>
+    void runTable(const ThroughputOptions & options, const Workload<Key> & w)
+    {
+        std::size_t n = w.elements;
+        std::size_t samples = options.latencySamples;
+        std::size_t bytes = sizeof(Key);
+        auto nothing = [](Set &) { };
+        auto fill = [&w](Set & set) {
+            for (std::size_t i = 0; i < w.elements; ++i)
+                set.insert(w.keys[i]);
+        };
+
+        report(options, bytes, n, w.loadFactor, Set::name(), "insert",
+               measure<Set>(w, n, samples, nothing, [&w](Set & set, std::size_t i) { return set.insert(w.keys[i]); }));
+        report(options, bytes, n, w.loadFactor, Set::name(), "lookup+",
+               measure<Set>(w, n, samples, fill, [&w](Set & set, std::size_t i) { return set.contains(w.lookups[i]); }));
+        report(options, bytes, n, w.loadFactor, Set::name(), "lookup-",
+               measure<Set>(w, n, samples, fill, [&w](Set & set, std::size_t i) { return set.contains(w.misses[i]); }));
+        report(options, bytes, n, w.loadFactor, Set::name(), "erase",
+               measure<Set>(w, n, samples, fill, [&w](Set & set, std::size_t i) { return set.remove(w.lookups[i]); }));
+
+        // Half lookups, a quarter insertions and a quarter removals, which keep the size steady: every
+        // four operations the oldest key is removed and a new one inserted, so the live keys are
+        // always ids [i / 4, n + i / 4)
+        std::size_t mixedOps = n / 4 * 4;
+        report(options, bytes, n, w.loadFactor, Set::name(), "mixed",
+               measure<Set>(w, mixedOps, samples, fill, [&w](Set & set, std::size_t i) {
+                   std::size_t quad = i / 4;
+                   switch (i % 4)
+                   {
+                   case 2:
+                       return set.insert(w.newKeys[quad]);
+                   case 3:
+                       return set.remove(w.keys[quad]);
+                   default:
+                       return set.contains(w.liveKey(quad + w.offsets[i] % w.elements));
+                   }
+               }));
+    }
+
+    template <std::size_t Bytes>
+    void runKeySize(const ThroughputOptions & options)
+    {
+        typedef BenchKey<Bytes> Key;
+
+        for (std::size_t elements : options.elementCounts)
+        {
+            if (elements < 4)
+                continue;
+            if (elements * Bytes > options.maxKeyMegabytes * 1024 * 1024)
+            {
+                std::cerr << "Skipping " << elements << " keys of " << Bytes << " bytes: more than "
+                          << options.maxKeyMegabytes << " MB of keys" << std::endl;
+                continue;
+            }
+
+            Workload<Key> w;
+            makeWorkload(w, elements);
+            for (double loadFactor : options.loadFactors)
+            {
+                w.loadFactor = loadFactor;
+                runTable<CuckooSet<Key>>(options, w);
+                runTable<StdSet<Key>>(options, w);
+                runTable<LinearSet<Key>>(options, w);
+            }
+        }
+    }
+}
+
+void runThroughputBenchmarks(const ThroughputOptions & options)
+{
+    if (options.csv)
+    {
+        std::cout << "key_bytes,elements,load_factor,table,workload,mops,p50_ns,p99_ns,p999_ns,max_ns" << std::endl;
+    }
+    else
+    {
+        std::cout << "Latencies are in ns and include about " << (int)clockOverheadNanoseconds()
+                  << " ns of reading the clock" << std::endl;
+        std::cout << "All tables hash with CuckooHashFamily: a multiply-fold mixer for 4, 8 and 16-byte keys, "
+                  << "MurmurHash64 for the rest" << std::endl;
+        std::cout << "  key  elements  load  table                 workload    Mops/s      p50      p99    p99.9        max" << std::endl;
+    }
+
+    for (std::size_t keyBytes : options.keySizes)
+    {
+        switch (keyBytes)
+        {
+        case 4:
+            runKeySize<4>(options);
+            break;
+        case 8:
+            runKeySize<8>(options);
+            break;
+        case 16:
+            runKeySize<16>(options);
+            break;
+        case 32:
+            runKeySize<32>(options);
+            break;
+        case 64:
+            runKeySize<64>(options);
+            break;
+        case 128:
+            runKeySize<128>(options);
+            break;
+        case 256:
+            runKeySize<256>(options);
+            break;
+        default:
+            std::cerr << "Skipping " << keyBytes << "-byte keys: only 4, 8, 16, 32, 64, 128 and 256 are supported" << std::endl;
+            break;
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+struct ThroughputOptions
+{
+    std::vector<std::size_t> keySizes;      // Bytes per key; 4 to 256 in steps of powers of two
+    std::vector<std::size_t> elementCounts; // Elements in the table once it's filled
+    std::vector<double> loadFactors;        // Elements per slot each table is sized for up front
+    std::size_t latencySamples;             // Operations timed individually per workload
+    std::size_t maxKeyMegabytes;            // Configurations whose keys would take more than this are skipped
+    bool csv;
+};
+
+// Times insert, positive lookup, negative lookup, erase and a mixed workload on CuckooHashTable,
+// std::unordered_set and LinearProbingHashSet for every combination of key size, element count and
+// load factor, and prints throughput and latency percentiles for each
+void runThroughputBenchmarks(const ThroughputOptions & options);
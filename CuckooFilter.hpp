@@ -0,0 +1,268 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "CuckooHashTable.hpp"
+
+// Smallest fingerprint size of at least bits (up to 32) that meets rate; see cuckooFilterBitsFor.
+// Recursive rather than a loop so that it's a C++11 constexpr function
+constexpr std::size_t cuckooFilterBitsFrom(std::size_t bits, double rate, std::size_t bucketSize)
+{
+    return bits >= 32 || 2.0 * bucketSize / ((1ull << bits) - 1) <= rate
+        ? bits
+        : cuckooFilterBitsFrom(bits + 1, rate, bucketSize);
+}
+
+// Smallest fingerprint size that gives a CuckooFilter with the given bucket size a false positive
+// rate of at most rate, e.g. CuckooFilter<T, cuckooFilterBitsFor(0.001)>
+constexpr std::size_t cuckooFilterBitsFor(double rate, std::size_t bucketSize = 4)
+{
+    return cuckooFilterBitsFrom(2, rate, bucketSize);
+}
+
+// Approximate set membership with cuckoo hashing (see Fan et al., "Cuckoo Filter: Practically
+// Better Than Bloom"). Instead of elements, the filter stores a FingerprintBits-bit fingerprint of
+// each one, packed into buckets of BucketSize slots. contains() never misses an element that was
+// inserted, but reports elements that weren't with probability of about
+// 2 * BucketSize / 2^FingerprintBits (see falsePositiveRate()).
+//
+// Since the elements themselves aren't kept, an element's alternate bucket has to be worked out
+// from its fingerprint alone: bucket1 = bucket0 ^ hash(fingerprint), which maps either bucket to
+// the other. This needs a power-of-two number of buckets. For the same reason the filter can't be
+// resized: insert() returns false once it's full.
+//
+// Inserting an element twice stores two fingerprints, and remove() takes one away; removing an
+// element that was never inserted may remove another element's fingerprint instead
+template <typename AnyType, std::size_t FingerprintBits = 12, std::size_t BucketSize = 4,
+          typename HashFamily = CuckooHashFamily<AnyType>>
+class CuckooFilter
+{
+    static_assert(FingerprintBits >= 2 && FingerprintBits <= 32, "CuckooFilter fingerprints are 2 to 32 bits");
+    static_assert(BucketSize > 0, "CuckooFilter needs at least one slot per bucket");
+
+public:
+    // capacity is the number of elements the filter should be able to hold
+    explicit CuckooFilter(std::size_t capacity = 1024)
+        : numBuckets_(PowerOfTwoSizePolicy::roundSize((std::size_t)(capacity / (BucketSize * cuckooMaxLoad(BucketSize))) + 1)),
+          slots_((numBuckets_ * BucketSize * FingerprintBits + 7) / 8 + sizeof(std::uint64_t), 0),
+          currentSize_(0),
+          hasVictim_(false),
+          victimBucket_(0),
+          victimFingerprint_(EMPTY)
+    {
+    }
+
+    void makeEmpty()
+    {
+        std::fill(slots_.begin(), slots_.end(), 0);
+        currentSize_ = 0;
+        hasVictim_ = false;
+    }
+
+    std::size_t size() const
+    {
+        return currentSize_;
+    }
+
+    // Number of fingerprints the filter has room for; in practice insertions start failing at
+    // around cuckooMaxLoad(BucketSize) of this
+    std::size_t capacity() const
+    {
+        return numBuckets_ * BucketSize;
+    }
+
+    // Bytes used for fingerprints
+    std::size_t memoryUsage() const
+    {
+        return slots_.size();
+    }
+
+    static double falsePositiveRate()
+    {
+        return 2.0 * BucketSize / ((1ull << FingerprintBits) - 1);
+    }
+
+    bool contains(const AnyType & x) const
+    {
+        std::uint64_t bucket0;
+        std::uint32_t fingerprint;
+        hashOf(x, bucket0, fingerprint);
+        std::uint64_t bucket1 = alternateBucket(bucket0, fingerprint);
+
+        if (hasVictim_ && victimFingerprint_ == fingerprint && (victimBucket_ == bucket0 || victimBucket_ == bucket1))
+            return true;
+        return findInBucket(bucket0, fingerprint) != -1 || findInBucket(bucket1, fingerprint) != -1;
+    }
+
+    // Returns false if the filter is full. x is then not in the filter, unless it already was
+    bool insert(const AnyType & x)
+    {
+        // The last fingerprint that couldn't be placed is still waiting in the victim slot
+        if (hasVictim_)
+            return false;
+
+        std::uint64_t bucket;
+        std::uint32_t fingerprint;
+        hashOf(x, bucket, fingerprint);
+
+        if (place(bucket, fingerprint) || place(alternateBucket(bucket, fingerprint), fingerprint))
+        {
+            ++currentSize_;
+            return true;
+        }
+
+        // Both buckets are full: evict a random fingerprint from one of them to its other bucket,
+        // and so on, until one lands in a bucket with room
+        if (random_() & 1)
+            bucket = alternateBucket(bucket, fingerprint);
+        for (int kick = 0; kick < MAX_KICKS; ++kick)
+        {
+            std::size_t slot = bucket * BucketSize + (std::size_t)random_() % BucketSize;
+            std::uint32_t evicted = getSlot(slot);
+            setSlot(slot, fingerprint);
+            fingerprint = evicted;
+
+            bucket = alternateBucket(bucket, fingerprint);
+            if (place(bucket, fingerprint))
+            {
+                ++currentSize_;
+                return true;
+            }
+        }
+
+        // Give up, but keep the fingerprint that's left over so nothing already inserted goes missing
+        hasVictim_ = true;
+        victimBucket_ = bucket;
+        victimFingerprint_ = fingerprint;
+        ++currentSize_;
+        return true;
+    }
+
+    bool remove(const AnyType & x)
+    {
+        std::uint64_t bucket0;
+        std::uint32_t fingerprint;
+        hashOf(x, bucket0, fingerprint);
+        std::uint64_t bucket1 = alternateBucket(bucket0, fingerprint);
+
+        int slot = findInBucket(bucket0, fingerprint);
+        if (slot == -1)
+            slot = findInBucket(bucket1, fingerprint);
+
+        if (slot != -1)
+        {
+            setSlot(slot, EMPTY);
+
+            // There's now room for the victim in one of its buckets
+            if (hasVictim_)
+            {
+                hasVictim_ = false;
+                insertFingerprint(victimBucket_, victimFingerprint_);
+            }
+        }
+        else if (hasVictim_ && victimFingerprint_ == fingerprint && (victimBucket_ == bucket0 || victimBucket_ == bucket1))
+        {
+            hasVictim_ = false;
+        }
+        else
+        {
+            return false;
+        }
+
+        --currentSize_;
+        return true;
+    }
+
+private:
+    // Low bits of the hash pick the bucket, bits 32 and up the fingerprint; 0 marks an empty slot
+    void hashOf(const AnyType & x, std::uint64_t & bucket, std::uint32_t & fingerprint) const
+    {
+        std::uint64_t hash = hashFunctions_.hash(x, 0);
+        bucket = hash & (numBuckets_ - 1);
+        fingerprint = (std::uint32_t)((hash >> 32) & FINGERPRINT_MASK);
+        if (fingerprint == EMPTY)
+            fingerprint = 1;
+    }
+
+    // Maps either of an element's buckets to the other one
+    std::uint64_t alternateBucket(std::uint64_t bucket, std::uint32_t fingerprint) const
+    {
+        std::uint64_t mixed = fingerprint * 0xc6a4a7935bd1e995ull;
+        return (bucket ^ (mixed ^ (mixed >> 47))) & (numBuckets_ - 1);
+    }
+
+    // Re-inserts a fingerprint that's already counted in the filter's size
+    void insertFingerprint(std::uint64_t bucket, std::uint32_t fingerprint)
+    {
+        for (int kick = 0; kick < MAX_KICKS; ++kick)
+        {
+            if (place(bucket, fingerprint) || place(alternateBucket(bucket, fingerprint), fingerprint))
+                return;
+
+            std::size_t slot = bucket * BucketSize + (std::size_t)random_() % BucketSize;
+            std::uint32_t evicted = getSlot(slot);
+            setSlot(slot, fingerprint);
+            fingerprint = evicted;
+            bucket = alternateBucket(bucket, fingerprint);
+        }
+
+        hasVictim_ = true;
+        victimBucket_ = bucket;
+        victimFingerprint_ = fingerprint;
+    }
+
+    // Puts fingerprint in a free slot of the bucket, if it has one
+    bool place(std::uint64_t bucket, std::uint32_t fingerprint)
+    {
+        int slot = findInBucket(bucket, EMPTY);
+        if (slot == -1)
+            return false;
+
+        setSlot(slot, fingerprint);
+        return true;
+    }
+
+    int findInBucket(std::uint64_t bucket, std::uint32_t fingerprint) const
+    {
+        for (std::size_t slot = bucket * BucketSize; slot < (bucket + 1) * BucketSize; ++slot)
+            if (getSlot(slot) == fingerprint)
+                return (int)slot;
+        return -1;
+    }
+
+    // Slots are FingerprintBits wide and packed end to end, so a slot is read by loading the
+    // (little-endian) 64-bit word at its first byte and shifting. slots_ has 8 bytes of padding at
+    // the end so the last word is always there to load
+    std::uint32_t getSlot(std::size_t slot) const
+    {
+        std::size_t bit = slot * FingerprintBits;
+        std::uint64_t word;
+        std::memcpy(&word, &slots_[bit / 8], sizeof(word));
+        return (std::uint32_t)((word >> (bit % 8)) & FINGERPRINT_MASK);
+    }
+
+    void setSlot(std::size_t slot, std::uint32_t fingerprint)
+    {
+        std::size_t bit = slot * FingerprintBits;
+        std::uint64_t word;
+        std::memcpy(&word, &slots_[bit / 8], sizeof(word));
+        word &= ~((std::uint64_t)FINGERPRINT_MASK << (bit % 8));
+        word |= (std::uint64_t)fingerprint << (bit % 8);
+        std::memcpy(&slots_[bit / 8], &word, sizeof(word));
+    }
+
+    static const std::uint32_t FINGERPRINT_MASK = (std::uint32_t)((1ull << FingerprintBits) - 1);
+    static const std::uint32_t EMPTY = 0;
+    static const int MAX_KICKS = 500; // Evictions insert tries before declaring the filter full
+    std::size_t numBuckets_;
+    std::vector<std::uint8_t> slots_;
+    std::size_t currentSize_;
+    bool hasVictim_; // Whether a fingerprint that couldn't be placed is waiting in the victim slot
+    std::uint64_t victimBucket_;
+    std::uint32_t victimFingerprint_;
+    HashFamily hashFunctions_;
+    std::minstd_rand random_; // Picks the fingerprints to evict; each filter has its own
+};
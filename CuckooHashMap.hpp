@@ -0,0 +1,164 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include <tuple>
+#include "CuckooHashTable.hpp"
+
+// Gets the key from a map entry so that the underlying table only hashes and compares keys
+struct CuckooMapKey
+{
+    template <typename Pair>
+    const typename Pair::first_type & operator()(const Pair & entry) const
+    {
+        return entry.first;
+    }
+};
+
+// Key/value map that stores each value in the same slot as its key, using CuckooHashTable's
+// two-table eviction scheme. A lookup is a single probe of the key's two buckets
+template <typename Key, typename Value, typename HashFamily = CuckooHashFamily<Key>>
+class CuckooHashMap
+{
+public:
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<Key, Value> value_type;
+
+    explicit CuckooHashMap(std::size_t size = 101)
+        : table_(size)
+    {
+    }
+
+    void makeEmpty()
+    {
+        table_.makeEmpty();
+    }
+
+    std::size_t size() const
+    {
+        return table_.size();
+    }
+
+    bool empty() const
+    {
+        return table_.size() == 0;
+    }
+
+    bool contains(const Key & key) const
+    {
+        return table_.contains(key);
+    }
+
+    // Returns the value mapped to key, or nullptr if there isn't one. The pointer is invalidated
+    // by any subsequent insertion into the map
+    Value * find(const Key & key)
+    {
+        value_type * entry = table_.find(key);
+        return entry ? &entry->second : nullptr;
+    }
+
+    const Value * find(const Key & key) const
+    {
+        const value_type * entry = table_.find(key);
+        return entry ? &entry->second : nullptr;
+    }
+
+    bool remove(const Key & key)
+    {
+        return table_.remove(key);
+    }
+
+    // Heterogeneous lookups (see CuckooHashTable::contains), e.g. by string literal in a map keyed by
+    // std::string. Other key types are converted to Key by the overloads above
+    template <typename K, typename H = HashFamily, typename = typename std::enable_if<CuckooCanLookUp<H, K, Key>::value>::type>
+    bool contains(const K & key) const
+    {
+        return table_.contains(key);
+    }
+
+    template <typename K, typename H = HashFamily, typename = typename std::enable_if<CuckooCanLookUp<H, K, Key>::value>::type>
+    Value * find(const K & key)
+    {
+        value_type * entry = table_.find(key);
+        return entry ? &entry->second : nullptr;
+    }
+
+    template <typename K, typename H = HashFamily, typename = typename std::enable_if<CuckooCanLookUp<H, K, Key>::value>::type>
+    const Value * find(const K & key) const
+    {
+        const value_type * entry = table_.find(key);
+        return entry ? &entry->second : nullptr;
+    }
+
+    Value & operator[](const Key & key)
+    {
+        return *try_emplace(key).first;
+    }
+
+    Value & operator[](Key && key)
+    {
+        return *try_emplace(std::move(key)).first;
+    }
+
+    // Constructs a value from args if key isn't already mapped; otherwise leaves the map (and args)
+    // untouched. Returns the mapped value and whether it was inserted
+    template <typename... Args>
+    std::pair<Value *, bool> try_emplace(const Key & key, Args &&... args)
+    {
+        Value * existing = find(key);
+        if (existing)
+            return std::make_pair(existing, false);
+
+        return std::make_pair(insertNew(value_type(std::piecewise_construct, std::forward_as_tuple(key),
+                                                   std::forward_as_tuple(std::forward<Args>(args)...))), true);
+    }
+
+    template <typename... Args>
+    std::pair<Value *, bool> try_emplace(Key && key, Args &&... args)
+    {
+        Value * existing = find(key);
+        if (existing)
+            return std::make_pair(existing, false);
+
+        return std::make_pair(insertNew(value_type(std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+                                                   std::forward_as_tuple(std::forward<Args>(args)...))), true);
+    }
+
+    // Maps key to value, replacing any existing mapping. Returns the mapped value and whether it was inserted
+    template <typename V>
+    std::pair<Value *, bool> insert_or_assign(const Key & key, V && value)
+    {
+        Value * existing = find(key);
+        if (existing)
+        {
+            *existing = std::forward<V>(value);
+            return std::make_pair(existing, false);
+        }
+
+        return std::make_pair(insertNew(value_type(key, std::forward<V>(value))), true);
+    }
+
+    template <typename V>
+    std::pair<Value *, bool> insert_or_assign(Key && key, V && value)
+    {
+        Value * existing = find(key);
+        if (existing)
+        {
+            *existing = std::forward<V>(value);
+            return std::make_pair(existing, false);
+        }
+
+        return std::make_pair(insertNew(value_type(std::move(key), std::forward<V>(value))), true);
+    }
+
+private:
+    typedef CuckooHashTable<value_type, HashFamily, 4, 2, CuckooMapKey> Table;
+
+    // Pre-condition: entry's key isn't in the map
+    Value * insertNew(value_type && entry)
+    {
+        return &table_.insertNew(std::move(entry))->second;
+    }
+
+    Table table_;
+};
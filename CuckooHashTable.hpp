@@ -1,20 +1,464 @@
 #pragma once
 #include <cstddef>
 #include <vector>
+#include <memory>
+#include <new>
+#include <iterator>
+#include <algorithm>
+#include <initializer_list>
 #include <utility>
+#include <tuple>
 #include <random>
 #include <string>
 #include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <sstream>
+#include <thread>
+#include <exception>
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#endif
 #include "MurmurHash2.h"
+#include "MurmurHash3.h"
+#include "CuckooSimd.hpp"
+#include "CuckooStats.hpp"
 
 #define MAX_LOAD 0.50
 
-// Generic hash function that hashes the contents of x (treating x as an array of bytes)
-// Most classes should probably specialise this
+template <typename T>
+struct CuckooVoid
+{
+    typedef void type;
+};
+
+// Tells the hash families which bytes make up a key's value. Keys that compare equal must give the
+// same bytes, including keys of different types that are used for heterogeneous lookup (a
+// std::string, a const char * and a std::string_view with the same characters all give those
+// characters). A specialisation either points at bytes the key already has, with data() and size(),
+// or is composite (see CuckooKeyBytes<std::pair>) and appends its elements' bytes to a buffer
+template <typename T>
+struct CuckooObjectKeyBytes
+{
+    // Always sizeof(T) bytes, so CuckooHashFamily can pick a hash function for the size at compile time
+    typedef void object_bytes;
+
+    static const void * data(const T & x)
+    {
+        return &x;
+    }
+
+    static std::size_t size(const T &)
+    {
+        return sizeof(T);
+    }
+};
+
+// The default is the object itself. That's only right for types whose whole value is in their own
+// bytes, so types that own memory elsewhere don't compile rather than hash their pointers; padding
+// is hashed too, so specialise this for padded types as well
+template <typename T, typename Enable = void>
+struct CuckooKeyBytes : CuckooObjectKeyBytes<T>
+{
+    static_assert(std::is_trivially_copy_constructible<T>::value && std::is_trivially_destructible<T>::value,
+                  "Only keys with trivial copies can be hashed as their own bytes; specialise CuckooKeyBytes for this type");
+};
+
+template <typename CharT, typename Traits, typename Allocator>
+struct CuckooKeyBytes<std::basic_string<CharT, Traits, Allocator>>
+{
+    static const void * data(const std::basic_string<CharT, Traits, Allocator> & x)
+    {
+        return x.data();
+    }
+
+    static std::size_t size(const std::basic_string<CharT, Traits, Allocator> & x)
+    {
+        return x.size() * sizeof(CharT);
+    }
+};
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+template <typename CharT, typename Traits>
+struct CuckooKeyBytes<std::basic_string_view<CharT, Traits>>
+{
+    static const void * data(const std::basic_string_view<CharT, Traits> & x)
+    {
+        return x.data();
+    }
+
+    static std::size_t size(const std::basic_string_view<CharT, Traits> & x)
+    {
+        return x.size() * sizeof(CharT);
+    }
+};
+#endif
+
+// C strings hash their characters rather than the pointer, so they can be used to look up strings
+template <>
+struct CuckooKeyBytes<const char *>
+{
+    static const void * data(const char * x)
+    {
+        return x;
+    }
+
+    static std::size_t size(const char * x)
+    {
+        return std::strlen(x);
+    }
+};
+
+template <>
+struct CuckooKeyBytes<char *> : CuckooKeyBytes<const char *>
+{
+};
+
+// Whether CuckooKeyBytes hashes a T as the sizeof(T) bytes of the object itself
+template <typename T, typename = void>
+struct CuckooIsObjectBytes : std::false_type
+{
+};
+
+template <typename T>
+struct CuckooIsObjectBytes<T, typename CuckooVoid<typename CuckooKeyBytes<T>::object_bytes>::type> : std::true_type
+{
+};
+
+// Whether CuckooKeyBytes appends a T's elements to a buffer rather than pointing at its bytes
+template <typename T, typename = void>
+struct CuckooIsCompositeKey : std::false_type
+{
+};
+
+template <typename T>
+struct CuckooIsCompositeKey<T, typename CuckooVoid<typename CuckooKeyBytes<T>::composite>::type> : std::true_type
+{
+};
+
+template <typename T>
+void cuckooAppendKeyBytes(const T & x, std::string & out, std::true_type)
+{
+    CuckooKeyBytes<T>::append(x, out);
+}
+
+// Bytes that aren't a fixed size are preceded by their length, so ("ab", "c") and ("a", "bc") differ
+template <typename T>
+void cuckooAppendKeyBytes(const T & x, std::string & out, std::false_type)
+{
+    typedef CuckooKeyBytes<T> Bytes;
+    std::uint64_t size = Bytes::size(x);
+    if (!CuckooIsObjectBytes<T>::value)
+        out.append((const char *)&size, sizeof(size));
+    out.append((const char *)Bytes::data(x), (std::size_t)size);
+}
+
+// Appends the bytes CuckooKeyBytes gives for an element of a composite key to out
+template <typename T>
+void cuckooAppendKeyBytes(const T & x, std::string & out)
+{
+    cuckooAppendKeyBytes(x, out, CuckooIsCompositeKey<T>());
+}
+
+// Whether an object made of Elements is hashed as its own bytes: the elements all are, and they fill
+// the object without padding
+template <typename... Elements>
+struct CuckooAllObjectBytes : std::true_type
+{
+};
+
+template <typename Element, typename... Elements>
+struct CuckooAllObjectBytes<Element, Elements...>
+    : std::integral_constant<bool, CuckooIsObjectBytes<Element>::value && CuckooAllObjectBytes<Elements...>::value>
+{
+};
+
+template <typename... Elements>
+struct CuckooSizeSum : std::integral_constant<std::size_t, 0>
+{
+};
+
+template <typename Element, typename... Elements>
+struct CuckooSizeSum<Element, Elements...>
+    : std::integral_constant<std::size_t, sizeof(Element) + CuckooSizeSum<Elements...>::value>
+{
+};
+
+template <typename T, typename... Elements>
+struct CuckooIsPacked
+    : std::integral_constant<bool, CuckooAllObjectBytes<Elements...>::value && sizeof(T) == CuckooSizeSum<Elements...>::value>
+{
+};
+
+// Pairs and tuples of packed object-bytes elements are hashed as the object; any others hash their
+// elements one after another
+template <typename First, typename Second>
+struct CuckooKeyBytes<std::pair<First, Second>,
+                      typename std::enable_if<CuckooIsPacked<std::pair<First, Second>, First, Second>::value>::type>
+    : CuckooObjectKeyBytes<std::pair<First, Second>>
+{
+};
+
+template <typename First, typename Second>
+struct CuckooKeyBytes<std::pair<First, Second>,
+                      typename std::enable_if<!CuckooIsPacked<std::pair<First, Second>, First, Second>::value>::type>
+{
+    typedef void composite;
+
+    static void append(const std::pair<First, Second> & x, std::string & out)
+    {
+        cuckooAppendKeyBytes(x.first, out);
+        cuckooAppendKeyBytes(x.second, out);
+    }
+};
+
+template <std::size_t Index, std::size_t Count>
+struct CuckooTupleBytes
+{
+    template <typename Tuple>
+    static void append(const Tuple & x, std::string & out)
+    {
+        cuckooAppendKeyBytes(std::get<Index>(x), out);
+        CuckooTupleBytes<Index + 1, Count>::append(x, out);
+    }
+};
+
+template <std::size_t Count>
+struct CuckooTupleBytes<Count, Count>
+{
+    template <typename Tuple>
+    static void append(const Tuple &, std::string &)
+    {
+    }
+};
+
+template <typename... Elements>
+struct CuckooKeyBytes<std::tuple<Elements...>,
+                      typename std::enable_if<CuckooIsPacked<std::tuple<Elements...>, Elements...>::value>::type>
+    : CuckooObjectKeyBytes<std::tuple<Elements...>>
+{
+};
+
+template <typename... Elements>
+struct CuckooKeyBytes<std::tuple<Elements...>,
+                      typename std::enable_if<!CuckooIsPacked<std::tuple<Elements...>, Elements...>::value>::type>
+{
+    typedef void composite;
+
+    static void append(const std::tuple<Elements...> & x, std::string & out)
+    {
+        CuckooTupleBytes<0, sizeof...(Elements)>::append(x, out);
+    }
+};
+
+// Contiguous containers of object-bytes elements hash their elements' bytes in place
+template <typename T, typename Allocator>
+struct CuckooKeyBytes<std::vector<T, Allocator>,
+                      typename std::enable_if<CuckooIsObjectBytes<T>::value && !std::is_same<T, bool>::value>::type>
+{
+    static const void * data(const std::vector<T, Allocator> & x)
+    {
+        return x.data();
+    }
+
+    static std::size_t size(const std::vector<T, Allocator> & x)
+    {
+        return x.size() * sizeof(T);
+    }
+};
+
+// Vectors of anything else (and std::vector<bool>, which has no data()) hash their length and then
+// each element
+template <typename T, typename Allocator>
+struct CuckooKeyBytes<std::vector<T, Allocator>,
+                      typename std::enable_if<!CuckooIsObjectBytes<T>::value || std::is_same<T, bool>::value>::type>
+{
+    typedef void composite;
+
+    static void append(const std::vector<T, Allocator> & x, std::string & out)
+    {
+        std::uint64_t count = x.size();
+        out.append((const char *)&count, sizeof(count));
+        for (const T & element : x)
+            cuckooAppendKeyBytes(element, out);
+    }
+};
+
+// The bytes a hash family hashes for a key: the ones CuckooKeyBytes points at, or for composite keys
+// a buffer their elements are appended to
+template <typename Key, bool Composite = CuckooIsCompositeKey<Key>::value>
+class CuckooKeyView
+{
+public:
+    explicit CuckooKeyView(const Key & x)
+        : data_(CuckooKeyBytes<Key>::data(x)),
+          size_(CuckooKeyBytes<Key>::size(x))
+    {
+    }
+
+    const void * data() const
+    {
+        return data_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    const void * data_;
+    std::size_t size_;
+};
+
+template <typename Key>
+class CuckooKeyView<Key, true>
+{
+public:
+    explicit CuckooKeyView(const Key & x)
+    {
+        CuckooKeyBytes<Key>::append(x, buffer_);
+    }
+
+    const void * data() const
+    {
+        return buffer_.data();
+    }
+
+    std::size_t size() const
+    {
+        return buffer_.size();
+    }
+
+private:
+    std::string buffer_;
+};
+
+// Whether a HashFamily can hash types other than the table's key (see CuckooHashTable::contains)
+template <typename HashFamily, typename = void>
+struct CuckooIsTransparent : std::false_type
+{
+};
+
+template <typename HashFamily>
+struct CuckooIsTransparent<HashFamily, typename CuckooVoid<typename HashFamily::is_transparent>::type> : std::true_type
+{
+};
+
+// The character type of a string-like type, for matching lookup strings against string keys
+template <typename T>
+struct CuckooStringChar
+{
+};
+
+template <typename CharT, typename Traits, typename Allocator>
+struct CuckooStringChar<std::basic_string<CharT, Traits, Allocator>>
+{
+    typedef CharT type;
+};
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+template <typename CharT, typename Traits>
+struct CuckooStringChar<std::basic_string_view<CharT, Traits>>
+{
+    typedef CharT type;
+};
+#endif
+
+template <>
+struct CuckooStringChar<const char *>
+{
+    typedef char type;
+};
+
+template <>
+struct CuckooStringChar<char *>
+{
+    typedef char type;
+};
+
+// Whether a K can be looked up as it is in a table whose keys are Keys, which needs CuckooKeyBytes
+// to give the same bytes for a K as for an equal Key. True for strings, string views and C strings
+// looked up in a table of strings or string views of the same character type; specialise it as
+// std::true_type for other pairs. Lookups with any other type convert to the key type first
+template <typename K, typename Key, typename = void>
+struct CuckooIsHeterogeneousKey : std::false_type
+{
+};
+
+template <typename K, typename Key>
+struct CuckooIsHeterogeneousKey<K, Key, typename std::enable_if<!std::is_pointer<Key>::value &&
+    std::is_same<typename CuckooStringChar<K>::type, typename CuckooStringChar<Key>::type>::value>::type> : std::true_type
+{
+};
+
+// Whether a table with the given HashFamily and key type can look up a K without converting it
+template <typename HashFamily, typename K, typename Key>
+struct CuckooCanLookUp : std::integral_constant<bool, CuckooIsTransparent<HashFamily>::value &&
+    CuckooIsHeterogeneousKey<typename std::decay<const K>::type, Key>::value>
+{
+};
+
+// Hash functions for keys of a fixed number of bytes, each seeded with two secrets. Sizes without
+// one are hashed with MurmurHash64. The mixers are a single 64x64->128-bit multiply with the two
+// halves of the product xored together, which spreads every input bit over the whole hash
+template <std::size_t Size>
+struct CuckooFixedHasher
+{
+    static const bool fast = false;
+};
+
+template <>
+struct CuckooFixedHasher<4>
+{
+    static const bool fast = true;
+
+    static std::uint64_t hash(const void * data, const std::uint64_t * secrets)
+    {
+        std::uint32_t x;
+        std::memcpy(&x, data, sizeof(x));
+        return cuckooMulFold(x ^ secrets[0], secrets[1]);
+    }
+};
+
+template <>
+struct CuckooFixedHasher<8>
+{
+    static const bool fast = true;
+
+    static std::uint64_t hash(const void * data, const std::uint64_t * secrets)
+    {
+        std::uint64_t x;
+        std::memcpy(&x, data, sizeof(x));
+        return cuckooMulFold(x ^ secrets[0], secrets[1]);
+    }
+};
+
+// Multiplies the two halves together, so a half equal to its secret makes the hash 0 whatever the
+// other half is. The secrets are random, so keys can't be picked to do that
+template <>
+struct CuckooFixedHasher<16>
+{
+    static const bool fast = true;
+
+    static std::uint64_t hash(const void * data, const std::uint64_t * secrets)
+    {
+        std::uint64_t x[2];
+        std::memcpy(x, data, sizeof(x));
+        return cuckooMulFold(x[0] ^ secrets[0], x[1] ^ secrets[1]);
+    }
+};
+
+// Generic hash function that hashes the bytes CuckooKeyBytes gives for x. It takes any key type
+// with a CuckooKeyBytes, so tables using it support heterogeneous lookup. Keys of 4, 8 or 16 bytes
+// that are hashed as the object itself go through a CuckooFixedHasher mixer picked at compile
+// time, and everything else through MurmurHash64
 template <typename AnyType>
 class CuckooHashFamily
 {
     public:
+        typedef void is_transparent;
+
         CuckooHashFamily()
         {
             // Could loop infinitely, but probably won't
@@ -27,254 +471,1714 @@ class CuckooHashFamily
             {
                 seed2_ = rand();
             } while (seed2_ == seed1_ || seed2_ == 0);
+
+            deriveSecrets();
         }
         
-        // MurmurHash2 (See https://sites.google.com/site/murmurhash/, MurmurHash2_64.cpp)
-        std::uint64_t hash(const AnyType & x, int which) const
+        template <typename Key>
+        std::uint64_t hash(const Key & x, int which) const
+        {
+            return hashBytes(x, which, std::integral_constant<bool, useFixedHasher<Key>()>());
+        }
+
+        // Both hashes of each of four keys, with MurmurHash64x4 if the keys are all the same length and
+        // don't have a CuckooFixedHasher
+        template <typename Key>
+        void hashPairs4(const Key * const * keys, std::pair<std::uint64_t, std::uint64_t> * out) const
+        {
+            if (useFixedHasher<Key>())
+            {
+                for (int i = 0; i < 4; ++i)
+                    out[i] = std::make_pair(hash(*keys[i], 0), hash(*keys[i], 1));
+                return;
+            }
+
+            CuckooKeyView<Key> views[4] = { CuckooKeyView<Key>(*keys[0]), CuckooKeyView<Key>(*keys[1]),
+                                            CuckooKeyView<Key>(*keys[2]), CuckooKeyView<Key>(*keys[3]) };
+            std::size_t size = views[0].size();
+            if (views[1].size() != size || views[2].size() != size || views[3].size() != size)
+            {
+                for (int i = 0; i < 4; ++i)
+                    out[i] = std::make_pair(MurmurHash64(views[i].data(), (int)views[i].size(), seed1_),
+                                            MurmurHash64(views[i].data(), (int)views[i].size(), seed2_));
+                return;
+            }
+
+            const void * data[4] = { views[0].data(), views[1].data(), views[2].data(), views[3].data() };
+            std::uint64_t first[4];
+            std::uint64_t second[4];
+            MurmurHash64x4(data, (int)size, (unsigned int)seed1_, first);
+            MurmurHash64x4(data, (int)size, (unsigned int)seed2_, second);
+            for (int i = 0; i < 4; ++i)
+                out[i] = std::make_pair(first[i], second[i]);
+        }
+
+        void regenerate()
+        {
+            std::uint64_t prev_seed1 = seed1_;
+            std::uint64_t prev_seed2 = seed2_;
+
+            // Could loop infinitely, but probably won't
+            do
+            {
+                seed1_ = rand();
+            } while (seed1_ == 0 || seed1_ == prev_seed1);
+
+            do
+            {
+                seed2_ = rand();
+            } while (seed2_ == seed1_ || seed2_ == 0 || seed2_ == prev_seed2);
+
+            deriveSecrets();
+        }
+
+private:
+    template <typename Key>
+    static constexpr bool useFixedHasher()
+    {
+        return CuckooIsObjectBytes<Key>::value && CuckooFixedHasher<sizeof(Key)>::fast;
+    }
+
+    template <typename Key>
+    std::uint64_t hashBytes(const Key & x, int which, std::true_type) const
+    {
+        return CuckooFixedHasher<sizeof(Key)>::hash(&x, secrets_[which]);
+    }
+
+    // MurmurHash2 (See https://sites.google.com/site/murmurhash/, MurmurHash2_64.cpp)
+    template <typename Key>
+    std::uint64_t hashBytes(const Key & x, int which, std::false_type) const
+    {
+        CuckooKeyView<Key> view(x);
+        std::uint64_t seed = which == 0 ? seed1_ : seed2_;
+        return MurmurHash64(view.data(), (int)view.size(), seed);
+    }
+
+    // Spreads each seed over two 64-bit secrets for the CuckooFixedHasher mixers with SplitMix64
+    void deriveSecrets()
+    {
+        std::uint64_t state[2] = { seed1_, seed2_ };
+        for (int which = 0; which < 2; ++which)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                std::uint64_t z = (state[which] += 0x9e3779b97f4a7c15);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+                secrets_[which][i] = z ^ (z >> 31);
+            }
+        }
+    }
+
+    std::uint64_t seed1_;
+    std::uint64_t seed2_;
+    std::uint64_t secrets_[2][2]; // Secrets of the CuckooFixedHasher mixers for hash functions 0 and 1
+};
+
+// A key's two cuckoo hashes, for tables 0 and 1
+typedef std::pair<std::uint64_t, std::uint64_t> CuckooHashPair;
+
+// Like CuckooHashFamily, but hashes x once with the 128-bit MurmurHash3 and uses the two halves as
+// the two hashes. Tables get both from one pass over the key via hashPair()
+template <typename AnyType>
+class CuckooHashFamily128
+{
+    public:
+        typedef void is_transparent;
+
+        CuckooHashFamily128()
+        {
+            do
+            {
+                seed_ = rand();
+            } while (seed_ == 0);
+        }
+
+        template <typename Key>
+        std::uint64_t hash(const Key & x, int which) const
+        {
+            CuckooHashPair hashes = hashPair(x);
+            return which == 0 ? hashes.first : hashes.second;
+        }
+
+        template <typename Key>
+        CuckooHashPair hashPair(const Key & x) const
+        {
+            CuckooKeyView<Key> view(x);
+            std::uint64_t out[2];
+            MurmurHash3_x64_128(view.data(), (int)view.size(), seed_, out);
+            return CuckooHashPair(out[0], out[1]);
+        }
+
+        void regenerate()
+        {
+            std::uint32_t prev_seed = seed_;
+
+            do
+            {
+                seed_ = rand();
+            } while (seed_ == 0 || seed_ == prev_seed);
+        }
+
+private:
+    std::uint32_t seed_;
+};
+
+// Gets both hashes of x from a HashFamily: with hashPair() if it has one, otherwise with two calls to hash()
+template <typename HashFamily, typename Key, typename = void>
+struct CuckooPairHasher
+{
+    static CuckooHashPair hashPair(const HashFamily & hashes, const Key & x)
+    {
+        return CuckooHashPair(hashes.hash(x, 0), hashes.hash(x, 1));
+    }
+};
+
+template <typename HashFamily, typename Key>
+struct CuckooPairHasher<HashFamily, Key, decltype((void)std::declval<const HashFamily &>().hashPair(std::declval<const Key &>()))>
+{
+    static CuckooHashPair hashPair(const HashFamily & hashes, const Key & x)
+    {
+        return hashes.hashPair(x);
+    }
+};
+
+// Gets both hashes of each of count keys from a HashFamily: four at a time with hashPairs4() if it
+// has one, otherwise one at a time with CuckooPairHasher
+template <typename HashFamily, typename Key, typename = void>
+struct CuckooBatchHasher
+{
+    static void hashPairs(const HashFamily & hashes, const Key * const * keys, std::size_t count, CuckooHashPair * out)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            out[i] = CuckooPairHasher<HashFamily, Key>::hashPair(hashes, *keys[i]);
+    }
+};
+
+template <typename HashFamily, typename Key>
+struct CuckooBatchHasher<HashFamily, Key, decltype((void)std::declval<const HashFamily &>().hashPairs4(std::declval<const Key * const *>(), std::declval<CuckooHashPair *>()))>
+{
+    static void hashPairs(const HashFamily & hashes, const Key * const * keys, std::size_t count, CuckooHashPair * out)
+    {
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+            hashes.hashPairs4(keys + i, out + i);
+        for (; i < count; ++i)
+            out[i] = CuckooPairHasher<HashFamily, Key>::hashPair(hashes, *keys[i]);
+    }
+};
+
+// Maximum load factor for a table with the given number of slots per bucket and hash functions.
+// With one slot per bucket and two hash functions insertions start failing at around 50% load;
+// with 4-8 slot buckets each element has several choices at each of its two positions, so the
+// table can safely run at 90-95%. A third or fourth hash function raises the thresholds to about
+// 91% and 97% even with one slot per bucket
+constexpr double cuckooMaxLoad(std::size_t bucketSize, std::size_t numHashFunctions = 2)
+{
+    return numHashFunctions >= 4 ? (bucketSize == 1 ? 0.90 : 0.97)
+         : numHashFunctions == 3 ? (bucketSize == 1 ? 0.85 : 0.95)
+         : bucketSize == 1 ? MAX_LOAD
+         : bucketSize == 2 ? 0.85
+         : bucketSize < 8  ? 0.90
+         :                   0.95;
+}
+
+// See http://stackoverflow.com/questions/4475996/given-prime-number-n-compute-the-next-prime#answer-5694432
+inline int cuckooIsPrime(std::size_t x) {
+    std::size_t i;
+
+    for (i = 3; 1; i += 2)
+    {
+        std::size_t q = x / i;
+        if (q < i)
+            return 1;
+        if (x % i == 0)
+            return 0;
+    }
+    return 1;
+}
+
+inline std::size_t cuckooNextPrime(std::size_t x) {
+
+    if (x <= 2)
+        return 2;
+
+    // Start at an odd number
+    if (!(x & 1))
+        ++x;
+
+    for (; !cuckooIsPrime(x); x += 2)
+        ;
+    return x;
+}
+
+// 64x64-bit multiply, returning the high 64 bits of the product
+inline std::uint64_t cuckooMulHigh(std::uint64_t a, std::uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    return (std::uint64_t)(((unsigned __int128)a * b) >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return __umulh(a, b);
+#else
+    std::uint64_t aLow = a & 0xFFFFFFFF, aHigh = a >> 32;
+    std::uint64_t bLow = b & 0xFFFFFFFF, bHigh = b >> 32;
+    std::uint64_t lowLow = aLow * bLow;
+    std::uint64_t highLow = aHigh * bLow;
+    std::uint64_t lowHigh = aLow * bHigh;
+    std::uint64_t middle = (lowLow >> 32) + (highLow & 0xFFFFFFFF) + lowHigh;
+    return aHigh * bHigh + (highLow >> 32) + (middle >> 32);
+#endif
+}
+
+// Sizing policies choose the number of buckets in each table (roundSize returns the size to use for
+// a request of size buckets) and map a 64-bit hash to one of them (reduce returns a value in [0, size))
+
+// Prime sizes with modulo reduction. Uses every bit of the hash, but costs a division per probe
+// and a trial-division search for the next prime on every resize
+struct PrimeSizePolicy
+{
+    static std::size_t roundSize(std::size_t size)
+    {
+        return cuckooNextPrime(size);
+    }
+
+    static std::size_t reduce(std::uint64_t hash, std::size_t size)
+    {
+        return (std::size_t)(hash % size);
+    }
+};
+
+// Power-of-two sizes, reduced by masking off the low bits of the hash
+struct PowerOfTwoSizePolicy
+{
+    static std::size_t roundSize(std::size_t size)
+    {
+        std::size_t rounded = 1;
+        while (rounded < size)
+            rounded <<= 1;
+        return rounded;
+    }
+
+    static std::size_t reduce(std::uint64_t hash, std::size_t size)
+    {
+        return (std::size_t)(hash & (size - 1));
+    }
+};
+
+// Power-of-two sizes with Lemire's multiply-shift reduction ("A fast alternative to the modulo
+// reduction"), which takes the high bits of the hash instead of the low ones
+struct FastRangeSizePolicy
+{
+    static std::size_t roundSize(std::size_t size)
+    {
+        return PowerOfTwoSizePolicy::roundSize(size);
+    }
+
+    static std::size_t reduce(std::uint64_t hash, std::size_t size)
+    {
+        return (std::size_t)cuckooMulHigh(hash, size);
+    }
+};
+
+// Gets the part of a stored element that's hashed and compared; sets store the key itself
+struct CuckooIdentityKey
+{
+    template <typename T>
+    const T & operator()(const T & x) const
+    {
+        return x;
+    }
+};
+
+// BucketSize is the number of slots at each of an element's candidate positions. The default of 4
+// keeps a bucket of small elements within a single cache line; use 1 for classic cuckoo hashing.
+//
+// NumHashFunctions is the number of tables, each with its own hash function, and so the number of
+// candidate buckets per element. Each extra one costs a bucket probe on failed lookups but lets the
+// table run fuller and makes evictions much less likely to fail. The HashFamily only supplies two
+// hashes; the others are combined from those (see hashFor).
+// KeyOfValue lets other containers (see CuckooHashMap) store more than the key in each slot; the
+// HashFamily then hashes key_type rather than AnyType.
+//
+// Each slot has a one-byte tag alongside it (kept in a separate array) holding 8 bits of the key's
+// hash, or 0 if the slot is empty. A lookup compares the tag against a whole bucket's tags at once
+// and only looks at the elements whose tags match, so most failed lookups never touch element memory.
+//
+// With setIncrementalResize(true), growing the table doesn't rebuild it in one go: the old and new
+// slot arrays coexist, lookups check both, and every insert or remove moves a few of the old
+// buckets across until the old array is empty.
+//
+// An element that can't be placed without rebuilding the table goes into a small stash instead,
+// which every lookup also checks while it isn't empty; the table is only rebuilt once the stash is
+// full (see Kirsch et al., "More Robust Hashing: Cuckoo Hashing with a Stash").
+//
+// Removing elements shrinks the table again: once the load factor drops below the minimum load
+// factor the table is halved (repeatedly if need be), but never below the size it was constructed
+// with. The default minimum is a quarter of the maximum, so a table that has just grown or shrunk
+// is left about half full and needs many inserts or removes before it resizes again. Shrinking
+// always rebuilds the table in one go, taking in whatever an incremental resize hadn't moved yet,
+// so a table that's drained mid-migration still gives its memory back.
+//
+// SizePolicy picks the table sizes and how hashes are reduced to bucket indices; see PrimeSizePolicy.
+// Allocator provides the slot and tag arrays (see HugePageAllocator for large tables); the stash,
+// which never holds more than a few elements, always uses the default allocator. StatsPolicy
+// collects statistics (see CuckooStats.hpp); the default collects nothing and costs nothing
+template<typename AnyType, typename HashFamily = CuckooHashFamily<AnyType>, std::size_t BucketSize = 4,
+         std::size_t NumHashFunctions = 2, typename KeyOfValue = CuckooIdentityKey,
+         typename SizePolicy = PrimeSizePolicy, typename Allocator = std::allocator<AnyType>,
+         typename StatsPolicy = NoCuckooStats>
+class CuckooHashTable
+{
+    static_assert(BucketSize > 0, "CuckooHashTable needs at least one slot per bucket");
+    static_assert(BucketSize <= 32, "CuckooHashTable's tag matching handles at most 32 slots per bucket");
+    static_assert(NumHashFunctions >= 2 && NumHashFunctions <= 4, "CuckooHashTable supports 2 to 4 hash functions");
+
+public:
+    typedef typename std::decay<decltype(KeyOfValue()(std::declval<const AnyType &>()))>::type key_type;
+    typedef AnyType value_type;
+    typedef HashFamily hasher;
+    typedef Allocator allocator_type;
+
+    // Forward iterator over every element: the slot array, then the old slots during an incremental
+    // resize, then the stash. Any insertion or removal invalidates all iterators. Elements reached
+    // through a (non-const) iterator may be changed, but not in any way that changes their key
+    template <bool Const>
+    class Iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef AnyType value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<Const, const AnyType, AnyType>::type & reference;
+        typedef typename std::conditional<Const, const AnyType, AnyType>::type * pointer;
+
+        Iterator()
+            : table_(nullptr),
+              pos_(0)
+        {
+        }
+
+        // An iterator converts to a const_iterator
+        template <bool OtherConst, typename = typename std::enable_if<Const && !OtherConst>::type>
+        Iterator(const Iterator<OtherConst> & rhs)
+            : table_(rhs.table_),
+              pos_(rhs.pos_)
+        {
+        }
+
+        reference operator*() const
+        {
+            return const_cast<reference>(table_->elementAt(pos_));
+        }
+
+        pointer operator->() const
+        {
+            return &**this;
+        }
+
+        Iterator & operator++()
+        {
+            pos_ = table_->nextElement(pos_ + 1);
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator & rhs) const
+        {
+            return pos_ == rhs.pos_;
+        }
+
+        bool operator!=(const Iterator & rhs) const
+        {
+            return pos_ != rhs.pos_;
+        }
+
+    private:
+        friend class CuckooHashTable;
+        template <bool>
+        friend class Iterator;
+
+        Iterator(const CuckooHashTable * table, std::size_t pos)
+            : table_(table),
+              pos_(pos)
+        {
+        }
+
+        const CuckooHashTable * table_;
+        std::size_t pos_; // Position in the slots, old slots and stash taken one after another
+    };
+
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    // size is the number of slots requested per table; it's rounded up to a whole number of buckets
+    // and then to a size allowed by the SizePolicy
+    explicit CuckooHashTable(std::size_t size = 101, const Allocator & allocator = Allocator())
+        : storage_(SizePolicy::roundSize((size + BucketSize - 1) / BucketSize), allocator),
+          oldStorage_(0, allocator),
+          minTableSize_(storage_.tableSize),
+          minLoadFactor_(MAX_LOAD_FACTOR / 4),
+          migrated_(0),
+          incremental_(false),
+          currentSize_(0),
+          resizes_(0),
+          rehashes_(0)
+    {
+    }
+
+    // Builds a table of the elements of [first, last) with bulk_build, sized to hold them all
+    template <typename ForwardIt, typename = typename std::enable_if<!std::is_integral<ForwardIt>::value>::type>
+    CuckooHashTable(ForwardIt first, ForwardIt last, const Allocator & allocator = Allocator())
+        : CuckooHashTable(slotsFor((std::size_t)std::distance(first, last)), allocator)
+    {
+        bulk_build(first, last);
+    }
+
+    CuckooHashTable(const CuckooHashTable &) = default;
+    CuckooHashTable & operator=(const CuckooHashTable &) = default;
+
+    // Takes rhs's slot arrays without allocating, so it can't throw. rhs is left empty with no slot
+    // arrays; it can still be used, and allocates a table of its minimum size when next inserted into
+    CuckooHashTable(CuckooHashTable && rhs) noexcept(std::is_nothrow_move_constructible<HashFamily>::value &&
+                                                     std::is_nothrow_move_constructible<StatsPolicy>::value)
+        : storage_(std::move(rhs.storage_)),
+          oldStorage_(std::move(rhs.oldStorage_)),
+          minTableSize_(rhs.minTableSize_),
+          minLoadFactor_(rhs.minLoadFactor_),
+          migrated_(rhs.migrated_),
+          stash_(std::move(rhs.stash_)),
+          incremental_(rhs.incremental_),
+          currentSize_(rhs.currentSize_),
+          resizes_(rhs.resizes_),
+          rehashes_(rhs.rehashes_),
+          hashFunctions_(std::move(rhs.hashFunctions_)),
+          stats_(std::move(rhs.stats_))
+    {
+        rhs.migrated_ = 0;
+        rhs.stash_.clear();
+        rhs.currentSize_ = 0;
+    }
+
+    // rhs is left empty, keeping this table's old slots
+    CuckooHashTable & operator=(CuckooHashTable && rhs)
+    {
+        if (this != &rhs)
+        {
+            swap(rhs);
+            rhs.makeEmpty();
+        }
+        return *this;
+    }
+
+    void swap(CuckooHashTable & rhs)
+    {
+        using std::swap;
+        swap(storage_, rhs.storage_);
+        swap(oldStorage_, rhs.oldStorage_);
+        swap(minTableSize_, rhs.minTableSize_);
+        swap(minLoadFactor_, rhs.minLoadFactor_);
+        swap(migrated_, rhs.migrated_);
+        swap(stash_, rhs.stash_);
+        swap(incremental_, rhs.incremental_);
+        swap(currentSize_, rhs.currentSize_);
+        swap(resizes_, rhs.resizes_);
+        swap(rehashes_, rhs.rehashes_);
+        swap(hashFunctions_, rhs.hashFunctions_);
+        swap(stats_, rhs.stats_);
+    }
+    
+    iterator begin()
+    {
+        return iterator(this, nextElement(0));
+    }
+
+    iterator end()
+    {
+        return iterator(this, endPos());
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, nextElement(0));
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, endPos());
+    }
+
+    const_iterator cbegin() const
+    {
+        return begin();
+    }
+
+    const_iterator cend() const
+    {
+        return end();
+    }
+
+    void makeEmpty()
+    {
+        currentSize_ = 0;
+        storage_.clear();
+        oldStorage_ = Storage(0, storage_.allocator);
+        stash_.clear();
+    }
+
+    std::size_t size() const
+    {
+        return currentSize_;
+    }
+
+    // Number of slots in all the tables (not counting the old ones during an incremental resize)
+    std::size_t capacity() const
+    {
+        return storage_.slots();
+    }
+
+    // Whether growing the table migrates elements a few buckets at a time (see above) rather than all at once
+    void setIncrementalResize(bool incremental)
+    {
+        if (!incremental)
+            finishResize();
+        incremental_ = incremental;
+    }
+
+    double loadFactor() const
+    {
+        return storage_.slots() == 0 ? 0.0 : (double)currentSize_ / storage_.slots();
+    }
+
+    // Bytes taken up by the table, including its slot arrays
+    std::size_t memoryUsage() const
+    {
+        return sizeof(*this) + (storage_.slots() + oldStorage_.slots()) * (sizeof(AnyType) + 1) +
+               stash_.capacity() * sizeof(AnyType);
+    }
+
+    const StatsPolicy & stats() const
+    {
+        return stats_;
+    }
+
+    StatsPolicy & stats()
+    {
+        return stats_;
+    }
+
+    // The table's size, load and memory use along with whatever the StatsPolicy has collected, as a JSON object
+    std::string statsJson() const
+    {
+        std::ostringstream out;
+        out << "{\"size\":" << currentSize_
+            << ",\"capacity\":" << storage_.slots()
+            << ",\"loadFactor\":" << loadFactor()
+            << ",\"memoryBytes\":" << memoryUsage()
+            << ",\"stats\":";
+        stats_.writeJson(out);
+        out << "}";
+        return out.str();
+    }
+
+    // Sets the load factor below which removing an element halves the table; 0 turns shrinking off.
+    // Anything above half the maximum load factor is lowered to that, since the table would otherwise
+    // be over the maximum as soon as it had shrunk
+    void setMinLoadFactor(double minLoad)
+    {
+        minLoadFactor_ = std::min(minLoad, MAX_LOAD_FACTOR / 2);
+    }
+
+    // Rebuilds the table at the smallest size that holds the current elements, ignoring the
+    // constructed size. The next insertion will probably grow it again
+    void shrink_to_fit()
+    {
+        std::size_t buckets = (std::size_t)(currentSize_ / (MAX_LOAD_FACTOR * BucketSize * NumHashFunctions)) + 1;
+        finishResize();
+        if (SizePolicy::roundSize(buckets) < storage_.tableSize)
+            rehash(buckets);
+    }
+
+    // Moves everything left over from an incremental resize into the new slot array
+    void finishResize()
+    {
+        while (migrating())
+            migrateSome(MIGRATE_BUCKETS_PER_OP);
+    }
+
+    bool contains(const key_type & x) const
+    {
+        return containsKey(x);
+    }
+
+    // Returns the element with the given key, or nullptr if there isn't one. The pointer is
+    // invalidated by any subsequent insertion, since that can move elements around
+    AnyType * find(const key_type & x)
+    {
+        return const_cast<AnyType *>(findKey(x));
+    }
+
+    const AnyType * find(const key_type & x) const
+    {
+        return findKey(x);
+    }
+    
+    bool remove(const key_type & x)
+    {
+        return removeKey(x);
+    }
+
+    // Heterogeneous lookups, e.g. with a string literal or std::string_view in a table of std::strings,
+    // without converting to key_type first. Only offered if the HashFamily declares is_transparent and
+    // CuckooIsHeterogeneousKey says K hashes the same as an equal key_type; anything else, like an int
+    // in a table of std::uint64_t, goes through the overloads above and is converted
+    template <typename K, typename H = HashFamily, typename = typename std::enable_if<CuckooCanLookUp<H, K, key_type>::value>::type>
+    bool contains(const K & x) const
+    {
+        return containsKey<typename std::decay<const K>::type>(x);
+    }
+
+    template <typename K, typename H = HashFamily, typename = typename std::enable_if<CuckooCanLookUp<H, K, key_type>::value>::type>
+    AnyType * find(const K & x)
+    {
+        return const_cast<AnyType *>(findKey<typename std::decay<const K>::type>(x));
+    }
+
+    template <typename K, typename H = HashFamily, typename = typename std::enable_if<CuckooCanLookUp<H, K, key_type>::value>::type>
+    const AnyType * find(const K & x) const
+    {
+        return findKey<typename std::decay<const K>::type>(x);
+    }
+
+    template <typename K, typename H = HashFamily, typename = typename std::enable_if<CuckooCanLookUp<H, K, key_type>::value>::type>
+    bool remove(const K & x)
+    {
+        return removeKey<typename std::decay<const K>::type>(x);
+    }
+
+    // Constructs an element from args and inserts it, unless an element with the same key is
+    // already there. The element has to exist before it can be hashed, so it's built first and
+    // then moved into its slot
+    template <typename... Args>
+    bool emplace(Args &&... args)
+    {
+        AnyType x(std::forward<Args>(args)...);
+        CuckooHashPair hashes = hashOf(keyOf(x));
+        return insertHashed(std::move(x), hashes);
+    }
+
+    bool insert(const AnyType & x)
+    {
+        return insertHashed(x, hashOf(keyOf(x)));
+    }
+
+    bool insert(AnyType && x)
+    {
+        return insertHashed(std::move(x), hashOf(keyOf(x)));
+    }
+
+    // Batched versions of contains and insert for large numbers of keys. Keys are taken BATCH_SIZE at
+    // a time: the whole group is hashed and all the buckets of every key are prefetched before any of
+    // them is probed, so the cache misses for a group overlap instead of being taken one after another.
+    // This pays off once the table is too big for the cache; for small tables it's no faster than a loop
+
+    // Writes contains(key) for each key in [first, last) to out, and returns the end of the output.
+    // Keys are converted to key_type first unless contains() could take them as they are
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt contains_batch(ForwardIt first, ForwardIt last, OutputIt out) const
+    {
+        typedef decltype(*first) Reference;
+        typedef typename std::decay<Reference>::type Value;
+        typedef typename std::conditional<CuckooCanLookUp<HashFamily, Value, key_type>::value, Value, key_type>::type K;
+        typedef std::integral_constant<bool, std::is_lvalue_reference<Reference>::value &&
+                                             std::is_same<Value, K>::value> InPlace;
+
+        std::vector<K> converted;
+        if (!InPlace::value)
+            converted.reserve(BATCH_SIZE);
+
+        const K * keys[BATCH_SIZE];
+        CuckooHashPair hashes[BATCH_SIZE];
+        while (first != last)
+        {
+            std::size_t count = 0;
+            for (; first != last && count < BATCH_SIZE; ++first, ++count)
+                keys[count] = batchItem(converted, *first, InPlace());
+
+            hashesOf(keys, count, hashes);
+            for (std::size_t i = 0; i < count; ++i)
+                prefetch(hashes[i]);
+
+            int pos;
+            for (std::size_t i = 0; i < count; ++i)
+                *out++ = locate(*keys[i], hashes[i], pos) != nullptr || findInStash(*keys[i]) != -1;
+            converted.clear();
+        }
+        return out;
+    }
+
+    // Inserts every element of [first, last), returning the number that weren't already in the table.
+    // Elements that aren't AnyType lvalues are converted into a buffer first and moved from there
+    template <typename ForwardIt>
+    std::size_t insert_batch(ForwardIt first, ForwardIt last)
+    {
+        typedef decltype(*first) Reference;
+        typedef std::integral_constant<bool, std::is_lvalue_reference<Reference>::value &&
+                                             std::is_same<typename std::decay<Reference>::type, AnyType>::value> InPlace;
+
+        std::vector<AnyType> converted;
+        if (!InPlace::value)
+            converted.reserve(BATCH_SIZE);
+
+        const AnyType * elements[BATCH_SIZE];
+        const key_type * keys[BATCH_SIZE];
+        CuckooHashPair hashes[BATCH_SIZE];
+        std::size_t inserted = 0;
+        while (first != last)
+        {
+            std::size_t resizes = resizes_;
+            std::size_t count = 0;
+            for (; first != last && count < BATCH_SIZE; ++first, ++count)
+            {
+                elements[count] = batchItem(converted, *first, InPlace());
+                keys[count] = &keyOf(*elements[count]);
+            }
+
+            hashesOf(keys, count, hashes);
+            for (std::size_t i = 0; i < count; ++i)
+                prefetch(hashes[i]);
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                // An earlier insertion in the group may have rebuilt the table with new hash functions
+                if (resizes_ != resizes)
+                    hashes[i] = hashOf(*keys[i]);
+                if (InPlace::value ? insertHashed(*elements[i], hashes[i]) : insertHashed(std::move(converted[i]), hashes[i]))
+                    ++inserted;
+            }
+            converted.clear();
+        }
+        return inserted;
+    }
+
+    // Inserts every element of [first, last) (copying them), returning the number that weren't
+    // already in the table. An empty table is filled in parallel on up to threads threads, one per
+    // hardware thread by default. It's sized for all the elements at once and they're all hashed up
+    // front. Then, one table at a time, each thread puts the elements whose bucket in that table
+    // falls in its own range of buckets into free slots there, so no two threads ever write to the
+    // same bucket. The few elements whose buckets are all full by then are inserted one at a time
+    // afterwards, evicting others as usual. A table that isn't empty, or a short range, is just
+    // filled with insert_batch
+    template <typename ForwardIt>
+    std::size_t bulk_build(ForwardIt first, ForwardIt last, std::size_t threads = 0)
+    {
+        static_assert(std::is_same<typename std::iterator_traits<ForwardIt>::value_type, AnyType>::value,
+                      "bulk_build takes a range of the table's elements");
+
+        std::size_t count = (std::size_t)std::distance(first, last);
+        if (currentSize_ != 0 || migrating() || count < BULK_BUILD_MIN_ELEMENTS)
+            return insert_batch(first, last);
+
+        std::size_t buckets = SizePolicy::roundSize((slotsFor(count) + BucketSize - 1) / BucketSize);
+        if (buckets > storage_.tableSize)
+            storage_ = Storage(buckets, storage_.allocator);
+
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        threads = std::max<std::size_t>(1, std::min(threads, count / BULK_BUILD_MIN_ELEMENTS));
+
+        // Elements that aren't AnyType lvalues (from proxy or transforming iterators, say) are copied into
+        // a buffer first, since the temporaries *first returns don't outlive the statement. It's reserved
+        // up front so the pointers into it stay valid
+        typedef decltype(*first) Reference;
+        typedef std::integral_constant<bool, std::is_lvalue_reference<Reference>::value &&
+                                             std::is_same<typename std::decay<Reference>::type, AnyType>::value> InPlace;
+
+        std::vector<AnyType> converted;
+        if (!InPlace::value)
+            converted.reserve(count);
+
+        std::vector<const AnyType *> elements;
+        elements.reserve(count);
+        for (; first != last; ++first)
+            elements.push_back(batchItem(converted, *first, InPlace()));
+
+        std::vector<CuckooHashPair> hashes(count);
+        runParallel(threads, [&](std::size_t thread) {
+            const key_type * keys[BATCH_SIZE];
+            std::size_t end = count * (thread + 1) / threads;
+            for (std::size_t i = count * thread / threads; i < end; i += BATCH_SIZE)
+            {
+                std::size_t n = end - i < BATCH_SIZE ? end - i : BATCH_SIZE;
+                for (std::size_t j = 0; j < n; ++j)
+                    keys[j] = &keyOf(*elements[i + j]);
+                hashesOf(keys, n, &hashes[i]);
+            }
+        });
+
+        std::vector<std::size_t> pending(count);
+        for (std::size_t i = 0; i < count; ++i)
+            pending[i] = i;
+
+        std::size_t placed = 0;
+        try
+        {
+            for (std::size_t which = 0; which < NumHashFunctions && !pending.empty(); ++which)
+                placed += placeInTable(elements, hashes, pending, (int)which, threads);
+        }
+        catch (...)
+        {
+            makeEmpty();
+            throw;
+        }
+
+        currentSize_ = placed;
+        for (std::size_t i = 0; i < placed; ++i)
+            stats_.onInsert();
+
+        // If one of these has to rebuild the table with new hash functions, the rest need rehashing
+        std::size_t inserted = placed;
+        std::size_t resizes = resizes_;
+        for (std::size_t i : pending)
+        {
+            if (resizes_ != resizes)
+                hashes[i] = hashOf(keyOf(*elements[i]));
+            if (insertHashed(*elements[i], hashes[i]))
+                ++inserted;
+        }
+        return inserted;
+    }
+
+private:
+    template <typename Table>
+    friend class CuckooSnapshot;
+    template <typename Key, typename Value, typename Hash>
+    friend class CuckooHashMap;
+
+    // Slots per table needed to hold n elements without growing
+    static std::size_t slotsFor(std::size_t n)
+    {
+        return (std::size_t)(n / (MAX_LOAD_FACTOR * NumHashFunctions)) + 1;
+    }
+
+    // One pass of bulk_build: puts each pending element that isn't already in the table into a free
+    // slot in its bucket in table which, if there is one. Only tables 0 to which can hold elements yet,
+    // so only those are searched for duplicates. Thread t handles the t-th of threads equal ranges of
+    // buckets. Leaves the elements that weren't placed in pending, and returns the number placed
+    std::size_t placeInTable(const std::vector<const AnyType *> & elements, const std::vector<CuckooHashPair> & hashes,
+                             std::vector<std::size_t> & pending, int which, std::size_t threads)
+    {
+        std::size_t count = pending.size();
+        std::vector<std::size_t> sorted;
+        std::vector<std::size_t> ownerStart(threads + 1, 0);
+        ownerStart[threads] = count;
+        if (threads == 1)
+            sorted.swap(pending);
+        else
+            sortByOwner(hashes, pending, which, threads, sorted, ownerStart);
+
+        // Only table which is written to, and each of its buckets by one thread only, so reading
+        // the earlier tables while looking for duplicates is safe
+        std::vector<std::vector<std::size_t>> leftovers(threads);
+        std::vector<std::size_t> placed(threads, 0);
+        runParallel(threads, [&](std::size_t thread) {
+            for (std::size_t k = ownerStart[thread]; k < ownerStart[thread + 1]; ++k)
+            {
+                std::size_t i = sorted[k];
+                const key_type & key = keyOf(*elements[i]);
+                std::uint8_t tag = tagFor(hashes[i].first);
+
+                bool present = false;
+                for (int other = 0; other <= which && !present; ++other)
+                    present = findInBucket(key, storage_.entries, storage_.tags.data(),
+                                           storage_.bucketFor(hashFor(hashes[i], other), other), tag) != -1;
+                if (present)
+                    continue;
+
+                int pos = storage_.findFreeSlot(storage_.bucketFor(hashFor(hashes[i], which), which));
+                if (pos == -1)
+                {
+                    leftovers[thread].push_back(i);
+                    continue;
+                }
+
+                storage_.construct(pos, tag, *elements[i]);
+                ++placed[thread];
+            }
+        });
+
+        std::size_t total = 0;
+        pending.clear();
+        for (std::size_t thread = 0; thread < threads; ++thread)
+        {
+            pending.insert(pending.end(), leftovers[thread].begin(), leftovers[thread].end());
+            total += placed[thread];
+        }
+        return total;
+    }
+
+    // Counting sort of pending into sorted by the thread that owns each element's bucket in table
+    // which, setting ownerStart[t] to where thread t's elements start. Each thread counts the owners
+    // in its chunk of pending, then, once every chunk's offsets are known, copies its chunk into place
+    void sortByOwner(const std::vector<CuckooHashPair> & hashes, const std::vector<std::size_t> & pending, int which,
+                     std::size_t threads, std::vector<std::size_t> & sorted, std::vector<std::size_t> & ownerStart) const
+    {
+        std::size_t count = pending.size();
+        std::vector<std::uint32_t> owners(count);
+        std::vector<std::size_t> offsets(threads * threads, 0); // [chunk * threads + owner]
+        runParallel(threads, [&](std::size_t thread) {
+            for (std::size_t i = count * thread / threads; i < count * (thread + 1) / threads; ++i)
+            {
+                std::uint64_t bucket = SizePolicy::reduce(hashFor(hashes[pending[i]], which), storage_.tableSize);
+                owners[i] = (std::uint32_t)(bucket * threads / storage_.tableSize);
+                ++offsets[thread * threads + owners[i]];
+            }
+        });
+
+        std::size_t offset = 0;
+        for (std::size_t owner = 0; owner < threads; ++owner)
         {
-            const std::uint64_t len = sizeof(x); // Assume 8-bit bytes
-            std::uint64_t seed = which == 0 ? seed1_ : seed2_;
-            return MurmurHash64((const void*)&x, len, seed);
+            ownerStart[owner] = offset;
+            for (std::size_t chunk = 0; chunk < threads; ++chunk)
+            {
+                std::size_t chunkCount = offsets[chunk * threads + owner];
+                offsets[chunk * threads + owner] = offset;
+                offset += chunkCount;
+            }
         }
 
-        void regenerate()
-        {
-            std::uint64_t prev_seed1 = seed1_;
-            std::uint64_t prev_seed2 = seed2_;
+        sorted.resize(count);
+        runParallel(threads, [&](std::size_t thread) {
+            for (std::size_t i = count * thread / threads; i < count * (thread + 1) / threads; ++i)
+                sorted[offsets[thread * threads + owners[i]]++] = pending[i];
+        });
+    }
 
-            // Could loop infinitely, but probably won't
-            do
+    // Runs task(0) to task(threads - 1) at the same time, task(0) on the calling thread, and once
+    // they've all finished rethrows the first exception any of them threw. If a thread can't be
+    // started, its task runs on the calling thread instead
+    template <typename Task>
+    static void runParallel(std::size_t threads, Task task)
+    {
+        std::vector<std::exception_ptr> errors(threads);
+        auto run = [&task, &errors](std::size_t thread) {
+            try
             {
-                seed1_ = rand();
-            } while (seed1_ == 0 || seed1_ == prev_seed1);
+                task(thread);
+            }
+            catch (...)
+            {
+                errors[thread] = std::current_exception();
+            }
+        };
 
-            do
+        std::vector<std::thread> workers;
+        workers.reserve(threads);
+        for (std::size_t thread = 1; thread < threads; ++thread)
+        {
+            try
             {
-                seed2_ = rand();
-            } while (seed2_ == seed1_ || seed2_ == 0 || seed2_ == prev_seed2);
+                workers.emplace_back(run, thread);
+            }
+            catch (...)
+            {
+                run(thread);
+            }
         }
+        run(0);
 
-private:
-    std::uint64_t seed1_;
-    std::uint64_t seed2_;
-};
+        for (std::thread & worker : workers)
+            worker.join();
+        for (std::exception_ptr & error : errors)
+            if (error)
+                std::rethrow_exception(error);
+    }
 
-template<typename AnyType, typename HashFamily = CuckooHashFamily<AnyType>>
-class CuckooHashTable
-{
-public:
-    explicit CuckooHashTable(std::size_t size = 101)
-        : tableSize_(nextPrime(size)),
-          currentSize_(0),
-          rehashes_(0),
-          entries_(tableSize_ * 2)
+    // Inserts x given its hashes, copying it if ElementRef is an lvalue reference and moving it otherwise
+    template <typename ElementRef>
+    bool insertHashed(ElementRef && x, CuckooHashPair hashes)
     {
-        makeEmpty();
+        int pos;
+        if (locate(keyOf(x), hashes, pos) || findInStash(keyOf(x)) != -1)
+            return false;
+
+        if (!makeRoomForInsert())
+            hashes = hashOf(keyOf(x));
+
+        currentSize_++;
+        stats_.onInsert();
+        insertHelper1(std::forward<ElementRef>(x), hashes);
+        return true;
     }
-    
-    void makeEmpty()
+
+    // Inserts x, whose key mustn't already be in the table, without looking for it first, and
+    // returns the element where it ended up. Nothing moves after the element's final placement, so
+    // that stays valid until the table is next changed. For CuckooHashMap, which has already looked
+    // the key up
+    AnyType * insertNew(AnyType && x)
     {
-        currentSize_ = 0;
-        for (auto & entry : entries_)
-            entry.isActive = false;
+        CuckooHashPair hashes = hashOf(keyOf(x));
+        if (!makeRoomForInsert())
+            hashes = hashOf(keyOf(x));
+
+        currentSize_++;
+        stats_.onInsert();
+        return insertHelper1(std::move(x), hashes);
+    }
+
+    // Puts back an element that was in the table before a rebuild; unlike insert, it can't be a duplicate
+    void reinsert(AnyType && x)
+    {
+        CuckooHashPair hashes = hashOf(keyOf(x));
+        if (!makeRoomForInsert())
+            hashes = hashOf(keyOf(x));
+
+        currentSize_++;
+        insertHelper1(std::move(x), hashes);
     }
 
-    bool contains(const AnyType & x) const
+    template <typename K>
+    bool containsKey(const K & x) const
     {
-        return findPos(x) != -1;
+        int pos;
+        return locate(x, hashOf(x), pos) != nullptr || findInStash(x) != -1;
     }
-    
-    // Pre-condition: x is actually in the table
-    bool remove(const AnyType & x)
+
+    template <typename K>
+    const AnyType * findKey(const K & x) const
     {
-        int currentPos = findPos(x);
-        if (!isActive(currentPos))
-            return false;
+        int pos;
+        const Storage * storage = locate(x, hashOf(x), pos);
+        if (storage)
+            return &storage->entries[pos];
+
+        pos = findInStash(x);
+        return pos == -1 ? nullptr : &stash_[pos];
+    }
+
+    template <typename K>
+    bool removeKey(const K & x)
+    {
+        migrateSome(MIGRATE_BUCKETS_PER_OP);
+
+        int currentPos;
+        Storage * storage = locate(x, hashOf(x), currentPos);
+        if (storage)
+        {
+            storage->destroy(currentPos);
+
+            // The slot that's just been freed may be one a stashed element can go back to
+            if (!stash_.empty())
+                drainStash();
+        }
+        else
+        {
+            currentPos = findInStash(x);
+            if (currentPos == -1)
+                return false;
+
+            stash_[currentPos] = std::move(stash_.back());
+            stash_.pop_back();
+        }
         
-        entries_[currentPos].isActive = false;
         --currentSize_;
+        stats_.onRemove();
+        if (currentSize_ < storage_.slots() * minLoadFactor_ && storage_.tableSize > minTableSize_)
+            shrink();
         return true;
     }
 
-    bool insert(const AnyType & x)
+    // Halves the table as many times as it takes to bring the load factor back above the minimum
+    void shrink()
     {
-        if (contains(x))
-            return false;
-        
-        if (currentSize_ >= entries_.size() * MAX_LOAD)
-            expand();
-        
-        currentSize_++;
-        return insertHelper1(x);
+        std::size_t newSize = storage_.tableSize / 2;
+        while (newSize / 2 >= minTableSize_ && currentSize_ < newSize * NumHashFunctions * BucketSize * minLoadFactor_)
+            newSize /= 2;
+        resize(std::max(newSize, minTableSize_));
     }
 
-    bool insert(AnyType && x)
+    // The slots of all the tables, each table's buckets following the last's. There are two of these while an
+    // incremental resize is in progress. The element array is raw memory: an element is constructed
+    // when it's stored and destroyed when it's removed, and the tags say which slots hold one
+    typedef std::allocator_traits<Allocator> AllocatorTraits;
+    typedef typename AllocatorTraits::template rebind_alloc<AnyType> ElementAllocator;
+    typedef typename AllocatorTraits::template rebind_alloc<std::uint8_t> TagAllocator;
+
+    struct Storage
     {
-        if (contains(x))
-            return false;
+        ElementAllocator allocator;
+        std::size_t tableSize; // Buckets per table
+        std::vector<std::uint8_t, TagAllocator> tags;
+        AnyType * entries; // Allocated last, so nothing else needs freeing if allocating it throws
 
-        if (currentSize_ >= entries_.size() * MAX_LOAD)
-            expand();
+        Storage(std::size_t size, const ElementAllocator & alloc)
+            : allocator(alloc),
+              tableSize(size),
+              tags(size * NumHashFunctions * BucketSize, EMPTY_TAG, TagAllocator(alloc)),
+              entries(size == 0 ? nullptr : std::allocator_traits<ElementAllocator>::allocate(allocator, size * NumHashFunctions * BucketSize)) { }
 
-        currentSize_++;
-        return insertHelper1(x);
-    }
+        Storage(const Storage & rhs)
+            : Storage(rhs.tableSize, rhs.allocator)
+        {
+            for (std::size_t pos = 0; pos < slots(); ++pos)
+                if (rhs.tags[pos] != EMPTY_TAG)
+                    construct(pos, rhs.tags[pos], rhs.entries[pos]);
+        }
 
-private:
-    struct HashEntry
-    {
-        AnyType element;
-        bool isActive;
-  
-        HashEntry(const AnyType & e = AnyType(), bool a = false)
-            : element{ e }, isActive{ a } { }
-        
-        HashEntry(AnyType && e, bool a = false)
-            : element{ std::move(e) }, isActive{ a } { }
+        // rhs keeps a copy of the allocator, so it can still be used to make new Storage
+        Storage(Storage && rhs) noexcept
+            : allocator(rhs.allocator),
+              tableSize(rhs.tableSize),
+              tags(std::move(rhs.tags)),
+              entries(rhs.entries)
+        {
+            rhs.tableSize = 0;
+            rhs.entries = nullptr;
+            rhs.tags.clear();
+        }
+
+        Storage & operator=(Storage rhs)
+        {
+            std::swap(allocator, rhs.allocator);
+            std::swap(tableSize, rhs.tableSize);
+            std::swap(entries, rhs.entries);
+            tags.swap(rhs.tags);
+            return *this;
+        }
+
+        ~Storage()
+        {
+            clear();
+            if (entries)
+                std::allocator_traits<ElementAllocator>::deallocate(allocator, entries, slots());
+        }
+
+        // Destroys every element; for trivially destructible elements this only has to reset the tags
+        void clear()
+        {
+            if (!std::is_trivially_destructible<AnyType>::value)
+                for (std::size_t pos = 0; pos < slots(); ++pos)
+                    if (tags[pos] != EMPTY_TAG)
+                        entries[pos].~AnyType();
+            std::fill(tags.begin(), tags.end(), EMPTY_TAG);
+        }
+
+        // Pre-condition: slot pos is empty
+        template <typename... Args>
+        void construct(std::size_t pos, std::uint8_t tag, Args &&... args)
+        {
+            ::new ((void *)(entries + pos)) AnyType(std::forward<Args>(args)...);
+            tags[pos] = tag;
+        }
+
+        void destroy(std::size_t pos)
+        {
+            entries[pos].~AnyType();
+            tags[pos] = EMPTY_TAG;
+        }
+
+        // Pre-condition: slot to is empty
+        void move(std::size_t from, std::size_t to)
+        {
+            construct(to, tags[from], std::move(entries[from]));
+            destroy(from);
+        }
+
+        std::size_t slots() const
+        {
+            return tags.size();
+        }
+
+        std::uint64_t bucketFor(std::uint64_t hash, int which) const
+        {
+            return CuckooHashTable::bucketFor(hash, which, tableSize);
+        }
+
+        // Returns the position of the first empty slot in the bucket, or -1 if the bucket is full
+        int findFreeSlot(std::uint64_t bucket) const
+        {
+            std::uint32_t empty = CuckooTagMatcher<BucketSize>::match(&tags[bucket * BucketSize], EMPTY_TAG);
+            return empty == 0 ? -1 : (int)(bucket * BucketSize + cuckooLowestBit(empty));
+        }
     };
 
-    bool insertHelper1(const AnyType & xx)
+    // Does the housekeeping that comes before an insertion: incremental migration and expansion.
+    // Returns false if the table was resized or rebuilt along the way, since a rebuild may have
+    // regenerated the hash functions and invalidated any hashes computed beforehand
+    bool makeRoomForInsert()
+    {
+        std::size_t resizes = resizes_;
+
+        // A moved-from table has no slot arrays until it's inserted into again. Hashes don't depend
+        // on the table size, so the ones already computed are still good
+        if (storage_.tableSize == 0)
+            storage_ = Storage(minTableSize_, storage_.allocator);
+
+        migrateSome(MIGRATE_BUCKETS_PER_OP);
+        if (currentSize_ >= storage_.slots() * MAX_LOAD_FACTOR)
+            expand();
+
+        return resizes_ == resizes;
+    }
+
+    // These return the element in its slot or in the stash
+    AnyType * insertHelper1(const AnyType & xx, const CuckooHashPair & hashes)
     {
         AnyType x = xx;
-        return insertHelper1(std::move(x));
+        return insertHelper1(std::move(x), hashes);
     }
 
-    bool insertHelper1(AnyType && xx)
+    AnyType * insertHelper1(AnyType && xx)
     {
-        const int EVICTION_LIMIT = 30; // Number of times we'll try to insert something before rehashing or expanding
+        CuckooHashPair hashes = hashOf(keyOf(xx));
+        return insertHelper1(std::move(xx), hashes);
+    }
 
+    AnyType * insertHelper1(AnyType && xx, const CuckooHashPair & hashes)
+    {
         AnyType curElem(std::move(xx));
-        int curHash = 0;
-        int curTable = 0;
-        int insertPos = 0;
-        int evictions = 0;
-        bool evicted;
+        if (AnyType * placed = tryPlace(curElem, hashes))
+            return placed;
+
+        // Park it in the stash rather than rebuilding the whole table for one unlucky element
+        if (stash_.size() < STASH_SIZE)
+        {
+            stash_.push_back(std::move(curElem));
+            stats_.onStashInsert();
+            return &stash_.back();
+        }
 
-        do
+        if (++rehashes_ < ALLOWED_REHASHES)
+        {
+            rehash();
+        }
+        else
         {
-            AnyType toInsert = std::move(curElem);
-            insertPos = (int)myhash(toInsert, (int)curHash);
-            evicted = false;
+            typename StatsPolicy::Timer timer = StatsPolicy::startTimer();
+            rehash(storage_.tableSize * 2);
+            stats_.onResize(true, timer);
+            rehashes_ = 0;
+        }
+
+        // The rebuild only counted the elements that were in the table
+        currentSize_++;
+
+        // Pretty bad luck if we end up in infinite recursion
+        return insertHelper1(std::move(curElem));
+    }
+
+    // Moves x into a slot if that can be done without rebuilding the table, returning the element
+    // there; otherwise leaves x alone and returns nullptr
+    AnyType * tryPlace(AnyType & x, const CuckooHashPair & hashes)
+    {
+        std::uint64_t buckets[NumHashFunctions];
+        for (std::size_t which = 0; which < NumHashFunctions; ++which)
+            buckets[which] = storage_.bucketFor(hashFor(hashes, (int)which), (int)which);
+
+        // Take a free slot in any of the buckets if there is one; only start evicting once they're all full
+        int freePos = -1;
+        for (std::size_t which = 0; which < NumHashFunctions && freePos == -1; ++which)
+            freePos = storage_.findFreeSlot(buckets[which]);
+        if (freePos == -1)
+            freePos = makeRoom(buckets);
+        if (freePos == -1)
+            return nullptr;
 
-            if (isActive(insertPos))
+        storage_.construct(freePos, tagFor(hashes.first), std::move(x));
+        return &storage_.entries[freePos];
+    }
+
+    // Moves stashed elements back into the slot arrays wherever there's now room for them
+    void drainStash()
+    {
+        for (std::size_t i = 0; i < stash_.size(); )
+        {
+            if (tryPlace(stash_[i], hashOf(keyOf(stash_[i]))) != nullptr)
             {
-                curHash = curHash == 0 ? 1 : 0;
-                curTable = curTable == 0 ? 1 : 0;
-                curElem = std::move(entries_[insertPos].element);
-                evictions++;
-                evicted = true;
+                stash_[i] = std::move(stash_.back());
+                stash_.pop_back();
             }
-            entries_[insertPos].element = std::move(toInsert);
-            entries_[insertPos].isActive = true;
-        } while (evicted && evictions < EVICTION_LIMIT);
+            else
+            {
+                ++i;
+            }
+        }
+    }
 
-        if (evictions == EVICTION_LIMIT)
+    template <typename K>
+    int findInStash(const K & x) const
+    {
+        for (std::size_t i = 0; i < stash_.size(); ++i)
         {
-            if (++rehashes_ < ALLOWED_REHASHES)
+            if (keyOf(stash_[i]) == x)
             {
-                rehash();
+                stats_.onStashHit();
+                return (int)i;
             }
-            else
+        }
+        return -1;
+    }
+
+    // One bucket visited by makeRoom's search
+    struct PathNode
+    {
+        std::uint64_t bucket;
+        int slot;   // Slot in the parent's bucket whose occupant would move to this bucket
+        int parent; // Index of the parent node in the search queue; -1 for x's own buckets
+    };
+
+    // Breadth-first search for the shortest chain of displacements that frees a slot in one of the
+    // given buckets (see Li et al., "Algorithmic Improvements for Fast Concurrent Cuckoo Hashing"). The
+    // chain is only carried out once it's known to end in a free slot, so a failed search leaves
+    // the table untouched. Returns the freed slot, or -1 if nothing was found within MAX_PATH_NODES buckets
+    int makeRoom(const std::uint64_t (&buckets)[NumHashFunctions])
+    {
+        PathNode queue[MAX_PATH_NODES];
+        int head = 0;
+        int tail = 0;
+        int freePos = -1;
+
+        for (std::size_t which = 0; which < NumHashFunctions; ++which)
+            queue[tail++] = PathNode{ buckets[which], -1, -1 };
+
+        for (; head < tail; ++head)
+        {
+            freePos = storage_.findFreeSlot(queue[head].bucket);
+            if (freePos != -1)
+                break;
+
+            // An occupant can move to its bucket in any of the other tables
+            int table = (int)(queue[head].bucket / storage_.tableSize);
+            int firstSlot = (int)(queue[head].bucket * BucketSize);
+            for (int slot = firstSlot; slot < firstSlot + (int)BucketSize && tail < MAX_PATH_NODES; ++slot)
             {
-                expand();
-                rehashes_ = 0;
+                const key_type & key = keyOf(storage_.entries[slot]);
+                CuckooHashPair hashes;
+                if (NumHashFunctions > 2)
+                    hashes = hashOf(key);
+
+                for (int which = 0; which < (int)NumHashFunctions && tail < MAX_PATH_NODES; ++which)
+                {
+                    if (which == table)
+                        continue;
+
+                    // With two tables only the one hash is needed
+                    std::uint64_t alternate = NumHashFunctions == 2 ? myhash(key, which)
+                                                                    : storage_.bucketFor(hashFor(hashes, which), which);
+
+                    // Moving an element through the same bucket twice could undo an earlier move
+                    bool onPath = false;
+                    for (int node = head; node != -1 && !onPath; node = queue[node].parent)
+                        onPath = queue[node].bucket == alternate;
+                    if (!onPath)
+                        queue[tail++] = PathNode{ alternate, slot, head };
+                }
             }
+        }
 
-            // Pretty bad luck if we end up in infinite recursion
-            insertHelper1(std::move(curElem));
-            return false;
+        if (freePos == -1)
+        {
+            stats_.onEvictionFailed();
+            return -1;
+        }
+
+        // Work back from the free slot, moving each element along one step; each move frees the
+        // slot the next one needs. Tags come from the same hash wherever an element is stored
+        std::size_t moves = 0;
+        for (int node = head; queue[node].parent != -1; node = queue[node].parent, ++moves)
+        {
+            int from = queue[node].slot;
+            storage_.move(from, freePos);
+            freePos = from;
+        }
+        stats_.onEviction(moves);
+        return freePos;
+    }
+
+    static const key_type & keyOf(const AnyType & x)
+    {
+        return KeyOfValue()(x);
+    }
+
+    // The tag is always taken from the table 0 hash, so an element's tag is the same in all
+    // of its buckets. Bits 32-39 are clear of both the low bits that masking reduces with and the
+    // high bits that multiply-shift reduces with. 0 is reserved for empty slots
+    static std::uint8_t tagFor(std::uint64_t hash0)
+    {
+        std::uint8_t tag = (std::uint8_t)(hash0 >> 32);
+        return tag == EMPTY_TAG ? 1 : tag;
+    }
+
+    // Both of x's hashes, from a single pass over x if the HashFamily supports it
+    template <typename K>
+    CuckooHashPair hashOf(const K & x) const
+    {
+        return CuckooPairHasher<HashFamily, K>::hashPair(hashFunctions_, x);
+    }
+
+    // The item of a batch that x gives: x itself when it can be used in place, otherwise a copy of
+    // it converted to T and kept in buffer, which must have room for it so that earlier items stay put
+    template <typename T>
+    static const T * batchItem(std::vector<T> &, const T & x, std::true_type)
+    {
+        return &x;
+    }
+
+    template <typename T, typename V>
+    static const T * batchItem(std::vector<T> & buffer, V && x, std::false_type)
+    {
+        buffer.emplace_back(std::forward<V>(x));
+        return &buffer.back();
+    }
+
+    // Both hashes of each of keys[0..count), several keys at a time if the HashFamily supports it
+    template <typename K>
+    void hashesOf(const K * const * keys, std::size_t count, CuckooHashPair * hashes) const
+    {
+        CuckooBatchHasher<HashFamily, K>::hashPairs(hashFunctions_, keys, count, hashes);
+    }
+
+    // Starts loading all of the buckets for hashes into the cache
+    void prefetch(const CuckooHashPair & hashes) const
+    {
+        if (storage_.tableSize == 0)
+            return;
+
+        for (std::size_t which = 0; which < NumHashFunctions; ++which)
+        {
+            std::uint64_t firstSlot = storage_.bucketFor(hashFor(hashes, (int)which), (int)which) * BucketSize;
+            cuckooPrefetch(&storage_.tags[firstSlot]);
+            cuckooPrefetch(&storage_.entries[firstSlot]);
         }
-        return true;
     }
 
-    bool isActive(int currentPos) const
+    // The hash for the given table. Tables 0 and 1 use the HashFamily's two hashes; any others use
+    // combinations of them, which work as well as independent hashes (see Kirsch and Mitzenmacher,
+    // "Less Hashing, Same Performance: Building a Better Bloom Filter")
+    static std::uint64_t hashFor(const CuckooHashPair & hashes, int which)
     {
-        return entries_[currentPos].isActive;
+        return which == 0 ? hashes.first : hashes.second + (std::uint64_t)(which - 1) * hashes.first;
     }
 
-    int findPos(const AnyType & x) const
+    static std::uint64_t bucketFor(std::uint64_t hash, int which, std::size_t tableSize)
     {
-        std::uint64_t pos0 = myhash(x, 0);
-        std::uint64_t pos1 = myhash(x, 1);
+        return SizePolicy::reduce(hash, tableSize) + (std::uint64_t)which * tableSize;
+    }
+
+    template <typename K>
+    static int findInBucket(const K & x, const AnyType * entries, const std::uint8_t * tags,
+                            std::uint64_t bucket, std::uint8_t tag)
+    {
+        std::uint32_t matches = CuckooTagMatcher<BucketSize>::match(&tags[bucket * BucketSize], tag);
+        for (; matches != 0; matches &= matches - 1)
+        {
+            int pos = (int)(bucket * BucketSize + cuckooLowestBit(matches));
+            if (keyOf(entries[pos]) == x)
+                return pos;
+        }
+        return -1;
+    }
+
+    // Returns x's slot in slot arrays laid out like Storage's, or -1 if it isn't there. This works on
+    // plain arrays so that CuckooSnapshot can probe a mapped file the same way
+    template <typename K>
+    static int findPos(const K & x, const CuckooHashPair & hashes, const AnyType * entries,
+                       const std::uint8_t * tags, std::size_t tableSize)
+    {
+        std::uint8_t tag = tagFor(hashes.first);
+
+        int pos = -1;
+        for (std::size_t which = 0; which < NumHashFunctions && pos == -1; ++which)
+            pos = findInBucket(x, entries, tags, bucketFor(hashFor(hashes, (int)which), (int)which, tableSize), tag);
+        return pos;
+    }
+
+    template <typename K>
+    int findPos(const K & x, const CuckooHashPair & hashes, const Storage & storage) const
+    {
+        return findPos(x, hashes, storage.entries, storage.tags.data(), storage.tableSize);
+    }
+
+    // Returns the storage holding x (nullptr if x isn't in the table) and sets pos to its slot there
+    template <typename K>
+    const Storage * locate(const K & x, const CuckooHashPair & hashes, int & pos) const
+    {
+        pos = -1;
+        if (storage_.tableSize == 0)
+            return nullptr;
+
+        pos = findPos(x, hashes, storage_);
+        if (pos != -1)
+            return &storage_;
+
+        if (migrating())
+        {
+            pos = findPos(x, hashes, oldStorage_);
+            if (pos != -1)
+                return &oldStorage_;
+        }
+        return nullptr;
+    }
+
+    template <typename K>
+    Storage * locate(const K & x, const CuckooHashPair & hashes, int & pos)
+    {
+        return const_cast<Storage *>(static_cast<const CuckooHashTable *>(this)->locate(x, hashes, pos));
+    }
+
+    // Iterator positions run through storage_'s slots, then oldStorage_'s, then the stash
+    std::size_t endPos() const
+    {
+        return storage_.slots() + oldStorage_.slots() + stash_.size();
+    }
+
+    // Returns the first position at or after pos that holds an element, or endPos()
+    std::size_t nextElement(std::size_t pos) const
+    {
+        for (; pos < storage_.slots(); ++pos)
+            if (storage_.tags[pos] != EMPTY_TAG)
+                return pos;
+
+        for (; pos < storage_.slots() + oldStorage_.slots(); ++pos)
+            if (oldStorage_.tags[pos - storage_.slots()] != EMPTY_TAG)
+                return pos;
+
+        return std::min(pos, endPos());
+    }
+
+    const AnyType & elementAt(std::size_t pos) const
+    {
+        if (pos < storage_.slots())
+            return storage_.entries[pos];
+
+        pos -= storage_.slots();
+        if (pos < oldStorage_.slots())
+            return oldStorage_.entries[pos];
+
+        return stash_[pos - oldStorage_.slots()];
+    }
+
+    bool migrating() const
+    {
+        return oldStorage_.tableSize != 0;
+    }
+
+    // Moves the contents of up to the given number of old buckets into the current slot array
+    void migrateSome(std::size_t buckets)
+    {
+        std::size_t oldBuckets = oldStorage_.tableSize * NumHashFunctions;
+        for (std::size_t i = 0; i < buckets && migrated_ < oldBuckets; ++i)
+        {
+            std::size_t resizes = resizes_;
+            std::size_t firstSlot = migrated_++ * BucketSize;
+            for (std::size_t slot = firstSlot; slot < firstSlot + BucketSize; ++slot)
+            {
+                if (oldStorage_.tags[slot] == EMPTY_TAG)
+                    continue;
+
+                AnyType element(std::move(oldStorage_.entries[slot]));
+                oldStorage_.destroy(slot);
+                insertHelper1(std::move(element));
 
-        if (isActive((int)pos0) && entries_[pos0].element == x)      return (int)pos0;
-        else if (isActive((int)pos1) && entries_[pos1].element == x) return (int)pos1;
-        else                                                         return -1;
+                // If that insertion had to rebuild the table, the old slots have already been moved
+                if (resizes_ != resizes)
+                    return;
+            }
+        }
+
+        if (migrating() && migrated_ == oldBuckets)
+            oldStorage_ = Storage(0, storage_.allocator);
     }
 
     void expand()
     {
-        rehash(static_cast<int>(tableSize_ / MAX_LOAD));
+        resize(storage_.tableSize * 2);
     }
-    
-    std::uint64_t myhash(const AnyType& x, int which) const
+
+    // Grows or shrinks the table to newSize buckets per table. Growing is incremental if that's turned
+    // on; shrinking is done in one go, as the elements left are few and the old arrays are freed at once
+    void resize(std::size_t newSize)
     {
-        if (which == 0)
+        typename StatsPolicy::Timer timer = StatsPolicy::startTimer();
+        bool grow = newSize > storage_.tableSize;
+        if (!incremental_ || !grow)
         {
-            return hashFunctions_.hash(x, 0) % tableSize_;
+            rehash(newSize);
         }
         else
         {
-            return hashFunctions_.hash(x, 1) % tableSize_ + tableSize_;
+            // Only one resize at a time; the new arrays are filled in by later inserts and removes
+            finishResize();
+            oldStorage_ = std::move(storage_);
+            storage_ = Storage(SizePolicy::roundSize(newSize), oldStorage_.allocator);
+            migrated_ = 0;
+            ++resizes_;
+            drainStash();
         }
+        stats_.onResize(grow, timer);
+    }
+    
+    // Returns the index of x's bucket in table 0 or 1
+    std::uint64_t myhash(const key_type& x, int which) const
+    {
+        return storage_.bucketFor(hashFunctions_.hash(x, which), which);
     }
 
     void rehash()
     {
+        typename StatsPolicy::Timer timer = StatsPolicy::startTimer();
         hashFunctions_.regenerate();
-        rehash(entries_.size());
+        rehash(storage_.tableSize);
+        stats_.onRehash(timer);
     }
 
+    // Rebuilds the table in one go with newSize buckets per table, taking in anything an incremental
+    // resize hadn't migrated yet
     void rehash(std::size_t newSize)
     {
-        std::vector<HashEntry> oldArray = entries_;
-        tableSize_ = nextPrime(newSize);
-
-        entries_.resize(tableSize_ * 2);
-        for (auto & entry : entries_)
-            entry.isActive = false;
+        Storage oldArray = std::move(storage_);
+        Storage unmigrated = std::move(oldStorage_);
+        std::vector<AnyType> stashed = std::move(stash_);
+        storage_ = Storage(SizePolicy::roundSize(newSize), oldArray.allocator);
+        oldStorage_ = Storage(0, oldArray.allocator);
+        stash_.clear();
+        ++resizes_;
        
         // Copy table over
         currentSize_ = 0;
-        for (auto & entry : oldArray)
-            if (entry.isActive)
-                insert(std::move(entry.element));
+        for (Storage * storage : { &oldArray, &unmigrated })
+            for (std::size_t pos = 0; pos < storage->slots(); ++pos)
+                if (storage->tags[pos] != EMPTY_TAG)
+                    reinsert(std::move(storage->entries[pos]));
+        for (auto & element : stashed)
+            reinsert(std::move(element));
     }
 
+    static constexpr double MAX_LOAD_FACTOR = cuckooMaxLoad(BucketSize, NumHashFunctions);
     static const int ALLOWED_REHASHES = 2;
-    std::size_t tableSize_;
-    std::vector<HashEntry> entries_;
+    static const int MAX_PATH_NODES = 256; // Buckets makeRoom will look at before giving up and rehashing
+    static const std::size_t MIGRATE_BUCKETS_PER_OP = 4; // Old buckets moved by each insert or remove during an incremental resize
+    static const std::size_t STASH_SIZE = 4;
+    static const std::size_t BUCKET_SIZE = BucketSize;
+    static const std::size_t NUM_HASH_FUNCTIONS = NumHashFunctions;
+    static const std::size_t BATCH_SIZE = 16; // Keys hashed and prefetched together by contains_batch and insert_batch
+    static const std::size_t BULK_BUILD_MIN_ELEMENTS = 1 << 14; // Elements per thread below which bulk_build doesn't go parallel
+    enum : std::uint8_t { EMPTY_TAG = 0 };
+    Storage storage_;
+    Storage oldStorage_; // Slots not yet migrated by an incremental resize
+    std::size_t minTableSize_; // Buckets per table that shrinking stops at
+    double minLoadFactor_;
+    std::size_t migrated_; // Old buckets migrated so far
+    std::vector<AnyType> stash_; // Elements that didn't fit; never more than STASH_SIZE
+    bool incremental_;
     std::size_t currentSize_;
-    std::size_t numHashFunctions_;
+    std::size_t resizes_;
     std::size_t rehashes_;
     HashFamily hashFunctions_;
-
-    // See http://stackoverflow.com/questions/4475996/given-prime-number-n-compute-the-next-prime#answer-5694432
-    int isPrime(std::size_t x) {
-        std::size_t i;
-
-        for (i = 3; 1; i += 2)
-        {
-            std::size_t q = x / i;
-            if (q < i)
-                return 1;
-            if (x % i == 0)
-                return 0;
-        }
-        return 1;
-    }
-
-    std::size_t nextPrime(std::size_t x) {
-
-        if (x <= 2)
-            return 2;
-
-        // Start at an odd number
-        if (!(x & 1))
-            ++x;
-
-        for (; !isPrime(x); x += 2)
-            ;
-        return x;
-    }
+    mutable StatsPolicy stats_; // Lookups report stash hits
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CUCKOO_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define CUCKOO_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit; mask must be non-zero
+inline unsigned cuckooLowestBit(std::uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned)index;
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+// Hints that the cache line holding address will be read soon. Does nothing on compilers without a prefetch intrinsic
+inline void cuckooPrefetch(const void * address)
+{
+#if defined(CUCKOO_SSE2)
+    _mm_prefetch((const char *)address, _MM_HINT_T0);
+#elif defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+// Multiplies a by b to a 128-bit product and returns its two halves xored together. A single
+// multiply instruction where the compiler has 128-bit integers or _umul128
+inline std::uint64_t cuckooMulFold(std::uint64_t a, std::uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = (unsigned __int128)a * b;
+    return (std::uint64_t)product ^ (std::uint64_t)(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    std::uint64_t high;
+    std::uint64_t low = _umul128(a, b, &high);
+    return low ^ high;
+#else
+    const std::uint64_t mask = 0xffffffff;
+    std::uint64_t lowLow = (a & mask) * (b & mask);
+    std::uint64_t highLow = (a >> 32) * (b & mask);
+    std::uint64_t lowHigh = (a & mask) * (b >> 32);
+    std::uint64_t cross = (lowLow >> 32) + (highLow & mask) + lowHigh;
+    std::uint64_t high = (a >> 32) * (b >> 32) + (highLow >> 32) + (cross >> 32);
+    return ((cross << 32) | (lowLow & mask)) ^ high;
+#endif
+}
+
+// Compares one tag against a whole bucket's worth of tags at once. match() returns a mask with bit i
+// set when tags[i] == tag. The generic version is a plain loop; common bucket sizes use SSE2/AVX2
+template <std::size_t BucketSize>
+struct CuckooTagMatcher
+{
+    static std::uint32_t match(const std::uint8_t * tags, std::uint8_t tag)
+    {
+        std::uint32_t mask = 0;
+        for (std::size_t i = 0; i < BucketSize; ++i)
+            if (tags[i] == tag)
+                mask |= 1u << i;
+        return mask;
+    }
+};
+
+#ifdef CUCKOO_SSE2
+template <>
+struct CuckooTagMatcher<4>
+{
+    static std::uint32_t match(const std::uint8_t * tags, std::uint8_t tag)
+    {
+        int word;
+        std::memcpy(&word, tags, sizeof(word));
+        __m128i equal = _mm_cmpeq_epi8(_mm_cvtsi32_si128(word), _mm_set1_epi8((char)tag));
+        return (std::uint32_t)_mm_movemask_epi8(equal) & 0xF;
+    }
+};
+
+template <>
+struct CuckooTagMatcher<8>
+{
+    static std::uint32_t match(const std::uint8_t * tags, std::uint8_t tag)
+    {
+        __m128i word = _mm_loadl_epi64((const __m128i *)tags);
+        __m128i equal = _mm_cmpeq_epi8(word, _mm_set1_epi8((char)tag));
+        return (std::uint32_t)_mm_movemask_epi8(equal) & 0xFF;
+    }
+};
+
+template <>
+struct CuckooTagMatcher<16>
+{
+    static std::uint32_t match(const std::uint8_t * tags, std::uint8_t tag)
+    {
+        __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)tags), _mm_set1_epi8((char)tag));
+        return (std::uint32_t)_mm_movemask_epi8(equal);
+    }
+};
+
+template <>
+struct CuckooTagMatcher<32>
+{
+    static std::uint32_t match(const std::uint8_t * tags, std::uint8_t tag)
+    {
+#ifdef CUCKOO_AVX2
+        __m256i equal = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)tags), _mm256_set1_epi8((char)tag));
+        return (std::uint32_t)_mm256_movemask_epi8(equal);
+#else
+        return CuckooTagMatcher<16>::match(tags, tag) | (CuckooTagMatcher<16>::match(tags + 16, tag) << 16);
+#endif
+    }
+};
+#endif
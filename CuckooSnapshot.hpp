@@ -0,0 +1,447 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include "CuckooHashTable.hpp"
+#include "MurmurHash2.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Fixed-size header at the start of a snapshot file. Everything after it is the payload:
+// the hash functions, the stash, the tags and the slot array, each starting on a 64-byte boundary
+struct CuckooSnapshotHeader
+{
+    char magic[8];             // CUCKOO_SNAPSHOT_MAGIC
+    std::uint32_t version;     // CUCKOO_SNAPSHOT_VERSION
+    std::uint32_t byteOrder;   // 0x01020304 as stored by the machine that wrote the file
+    std::uint64_t elementSize;
+    std::uint64_t bucketSize;
+    std::uint64_t hashFunctions;
+    std::uint64_t hasherSize;
+    std::uint64_t tableSize;   // Buckets per table
+    std::uint64_t size;        // Elements, including stashed ones
+    std::uint64_t stashSize;
+    std::uint64_t fileSize;
+    std::uint64_t checksum;    // Of the whole file with this field zeroed, see CuckooSnapshotChecksum
+};
+
+#define CUCKOO_SNAPSHOT_MAGIC "CUCKOOSS"
+#define CUCKOO_SNAPSHOT_VERSION 4
+
+// Checksum of a byte stream, fed in pieces of any size: MurmurHash64 over each 64 KB block in
+// turn, seeded with the hash of the block before
+class CuckooSnapshotChecksum
+{
+public:
+    CuckooSnapshotChecksum()
+        : value_(0),
+          buffered_(0)
+    {
+    }
+
+    void add(const void * data, std::size_t length)
+    {
+        const char * bytes = (const char *)data;
+        while (length > 0)
+        {
+            // Whole blocks can be hashed where they are
+            if (buffered_ == 0 && length >= BLOCK_SIZE)
+            {
+                addBlock(bytes, BLOCK_SIZE);
+                bytes += BLOCK_SIZE;
+                length -= BLOCK_SIZE;
+                continue;
+            }
+
+            std::size_t count = std::min(length, BLOCK_SIZE - buffered_);
+            std::memcpy(buffer_ + buffered_, bytes, count);
+            buffered_ += count;
+            bytes += count;
+            length -= count;
+            if (buffered_ == BLOCK_SIZE)
+            {
+                addBlock(buffer_, BLOCK_SIZE);
+                buffered_ = 0;
+            }
+        }
+    }
+
+    std::uint64_t value()
+    {
+        if (buffered_ > 0)
+        {
+            addBlock(buffer_, buffered_);
+            buffered_ = 0;
+        }
+        return value_;
+    }
+
+private:
+    void addBlock(const char * block, std::size_t length)
+    {
+        value_ = MurmurHash64(block, (int)length, (unsigned int)(value_ ^ (value_ >> 32)));
+    }
+
+    static const std::size_t BLOCK_SIZE = 64 * 1024;
+    std::uint64_t value_;
+    std::size_t buffered_;
+    char buffer_[BLOCK_SIZE];
+};
+
+// Read-only view of a CuckooHashTable saved to a file. save() writes the table's hash functions
+// and slot arrays as they are in memory; open() maps the file and looks keys up in place, so
+// opening even a huge table costs nothing up front and pages are only read as lookups touch them.
+//
+// The elements and the hash family must be trivially copyable (see below), and a snapshot can
+// only be opened as the same Table type it was saved from, on a machine with the same byte order.
+// The header records enough to reject files from a different element type, bucket size, number
+// of hash functions or format version; it can't tell two SizePolicies or HashFamilies of the same
+// size apart
+template <typename Table>
+class CuckooSnapshot
+{
+public:
+    typedef typename Table::key_type key_type;
+    typedef typename Table::value_type value_type;
+    typedef typename Table::hasher hasher;
+
+    // std::pair isn't trivially copyable because of its assignment operators, but pairs of trivially
+    // copyable types can still be copied bytewise, which is all a snapshot needs
+    static_assert(std::is_trivially_copy_constructible<value_type>::value && std::is_trivially_destructible<value_type>::value,
+                  "Only tables of trivially copyable elements can be saved");
+    static_assert(std::is_trivially_copyable<hasher>::value, "Only tables with trivially copyable hash functions can be saved");
+    static_assert(alignof(value_type) <= 64, "Snapshot sections are only 64-byte aligned");
+
+    CuckooSnapshot()
+        : data_(nullptr),
+          length_(0)
+    {
+        reset();
+    }
+
+    ~CuckooSnapshot()
+    {
+        close();
+    }
+
+    CuckooSnapshot(const CuckooSnapshot &) = delete;
+    CuckooSnapshot & operator=(const CuckooSnapshot &) = delete;
+
+    // Writes table to path, finishing any incremental resize first. Returns false if the file
+    // couldn't be written
+    static bool save(Table & table, const std::string & path)
+    {
+        table.finishResize();
+
+        // A moved-from table has no slot arrays; save it as an empty table of its minimum size
+        if (table.storage_.tableSize == 0)
+            table.storage_ = typename Table::Storage(table.minTableSize_, table.storage_.allocator);
+
+        CuckooSnapshotHeader header = CuckooSnapshotHeader();
+        std::memcpy(header.magic, CUCKOO_SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = CUCKOO_SNAPSHOT_VERSION;
+        header.byteOrder = 0x01020304;
+        header.elementSize = sizeof(value_type);
+        header.bucketSize = Table::BUCKET_SIZE;
+        header.hashFunctions = Table::NUM_HASH_FUNCTIONS;
+        header.hasherSize = sizeof(hasher);
+        header.tableSize = table.storage_.tableSize;
+        header.size = table.currentSize_;
+        header.stashSize = table.stash_.size();
+        Layout layout(header);
+        header.fileSize = layout.fileSize;
+
+        std::FILE * file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+
+        // The header goes into the checksum with the checksum field still zero, and is written again
+        // at the end once the checksum is known
+        Writer writer(file);
+        writer.write(&header, sizeof(header));
+
+        writer.pad(layout.hasher - writer.offset);
+        writer.write(&table.hashFunctions_, sizeof(hasher));
+        writer.pad(layout.stash - writer.offset);
+        writer.write(table.stash_.data(), table.stash_.size() * sizeof(value_type));
+        writer.pad(layout.tags - writer.offset);
+        writer.write(table.storage_.tags.data(), table.storage_.tags.size());
+        writer.pad(layout.entries - writer.offset);
+
+        // Empty slots hold no element, so they're written as zeroes
+        std::vector<char> chunk;
+        for (std::size_t first = 0; first < table.storage_.slots(); first += CHUNK_SLOTS)
+        {
+            std::size_t count = std::min(table.storage_.slots() - first, (std::size_t)CHUNK_SLOTS);
+            chunk.assign(count * sizeof(value_type), 0);
+            for (std::size_t i = 0; i < count; ++i)
+                if (table.storage_.tags[first + i] != Table::EMPTY_TAG)
+                    std::memcpy(&chunk[i * sizeof(value_type)], &table.storage_.entries[first + i], sizeof(value_type));
+            writer.write(chunk.data(), chunk.size());
+        }
+
+        header.checksum = writer.checksum.value();
+        bool ok = writer.ok && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+        return std::fclose(file) == 0 && ok;
+    }
+
+    // Maps the snapshot at path, replacing any snapshot that's already open. Returns false if the
+    // file can't be mapped or isn't a valid snapshot of this Table type. Verifying the checksum
+    // reads the whole file; skip it for a lazy load of a file that's known to be intact
+    bool open(const std::string & path, bool verifyChecksum = true)
+    {
+        close();
+        if (!map(path))
+            return false;
+
+        if (!validate(verifyChecksum))
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        unmap();
+        reset();
+    }
+
+    bool isOpen() const
+    {
+        return data_ != nullptr;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    bool contains(const key_type & x) const
+    {
+        return find(x) != nullptr;
+    }
+
+    // Returns the element with the given key, which points into the mapped file, or nullptr if
+    // there isn't one (or no snapshot is open)
+    const value_type * find(const key_type & x) const
+    {
+        if (!isOpen())
+            return nullptr;
+
+        CuckooHashPair hashes = CuckooPairHasher<hasher, key_type>::hashPair(hashFunctions_, x);
+        int pos = Table::findPos(x, hashes, entries_, tags_, tableSize_);
+        if (pos != -1)
+            return &entries_[pos];
+
+        for (std::size_t i = 0; i < stashSize_; ++i)
+            if (Table::keyOf(stash_[i]) == x)
+                return &stash_[i];
+        return nullptr;
+    }
+
+private:
+    // Offsets of each part of a snapshot file
+    struct Layout
+    {
+        std::uint64_t hasher;
+        std::uint64_t stash;
+        std::uint64_t tags;
+        std::uint64_t entries;
+        std::uint64_t fileSize;
+
+        explicit Layout(const CuckooSnapshotHeader & header)
+        {
+            std::uint64_t slots = header.tableSize * header.hashFunctions * header.bucketSize;
+            hasher = align(sizeof(CuckooSnapshotHeader));
+            stash = align(hasher + header.hasherSize);
+            tags = align(stash + header.stashSize * header.elementSize);
+            entries = align(tags + slots);
+            fileSize = entries + slots * header.elementSize;
+        }
+
+        static std::uint64_t align(std::uint64_t offset)
+        {
+            return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+    };
+
+    // Sequential file output that keeps a checksum of what's written
+    struct Writer
+    {
+        std::FILE * file;
+        std::uint64_t offset;
+        bool ok;
+        CuckooSnapshotChecksum checksum;
+
+        explicit Writer(std::FILE * f)
+            : file(f),
+              offset(0),
+              ok(true)
+        {
+        }
+
+        void write(const void * data, std::size_t length)
+        {
+            if (length == 0)
+                return;
+            ok = ok && std::fwrite(data, length, 1, file) == 1;
+            checksum.add(data, length);
+            offset += length;
+        }
+
+        void pad(std::uint64_t length)
+        {
+            static const char zeroes[ALIGNMENT] = {};
+            for (; length > ALIGNMENT; length -= ALIGNMENT)
+                write(zeroes, ALIGNMENT);
+            write(zeroes, (std::size_t)length);
+        }
+    };
+
+    bool validate(bool verifyChecksum)
+    {
+        if (length_ < sizeof(CuckooSnapshotHeader))
+            return false;
+
+        CuckooSnapshotHeader header;
+        std::memcpy(&header, data_, sizeof(header));
+        if (std::memcmp(header.magic, CUCKOO_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != CUCKOO_SNAPSHOT_VERSION ||
+            header.byteOrder != 0x01020304 ||
+            header.elementSize != sizeof(value_type) ||
+            header.bucketSize != Table::BUCKET_SIZE ||
+            header.hashFunctions != Table::NUM_HASH_FUNCTIONS ||
+            header.hasherSize != sizeof(hasher) ||
+            header.tableSize == 0 ||
+            header.stashSize > Table::STASH_SIZE ||
+            header.fileSize != length_)
+            return false;
+
+        Layout layout(header);
+        if (layout.fileSize != header.fileSize)
+            return false;
+
+        if (verifyChecksum)
+        {
+            CuckooSnapshotHeader unsummed = header;
+            unsummed.checksum = 0;
+            CuckooSnapshotChecksum checksum;
+            checksum.add(&unsummed, sizeof(unsummed));
+            checksum.add(data_ + sizeof(header), length_ - sizeof(header));
+            if (checksum.value() != header.checksum)
+                return false;
+        }
+
+        std::memcpy((void *)&hashFunctions_, data_ + layout.hasher, sizeof(hasher));
+        stash_ = (const value_type *)(data_ + layout.stash);
+        tags_ = (const std::uint8_t *)(data_ + layout.tags);
+        entries_ = (const value_type *)(data_ + layout.entries);
+        tableSize_ = (std::size_t)header.tableSize;
+        stashSize_ = (std::size_t)header.stashSize;
+        size_ = (std::size_t)header.size;
+        return true;
+    }
+
+    void reset()
+    {
+        stash_ = nullptr;
+        tags_ = nullptr;
+        entries_ = nullptr;
+        tableSize_ = 0;
+        stashSize_ = 0;
+        size_ = 0;
+    }
+
+#if defined(_WIN32)
+    bool map(const std::string & path)
+    {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER length;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &length) && length.QuadPart > 0)
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping)
+            return false;
+
+        data_ = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        length_ = data_ ? (std::size_t)length.QuadPart : 0;
+        return data_ != nullptr;
+    }
+
+    void unmap()
+    {
+        if (data_)
+            UnmapViewOfFile(data_);
+        data_ = nullptr;
+        length_ = 0;
+    }
+#else
+    bool map(const std::string & path)
+    {
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file == -1)
+            return false;
+
+        struct stat status;
+        void * data = MAP_FAILED;
+        if (fstat(file, &status) == 0 && status.st_size > 0)
+            data = mmap(nullptr, (std::size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+        ::close(file);
+        if (data == MAP_FAILED)
+            return false;
+
+        // Lookups jump all over the file, so readahead would mostly fetch pages that aren't needed
+        madvise(data, (std::size_t)status.st_size, MADV_RANDOM);
+        data_ = (const char *)data;
+        length_ = (std::size_t)status.st_size;
+        return true;
+    }
+
+    void unmap()
+    {
+        if (data_)
+            munmap((void *)data_, length_);
+        data_ = nullptr;
+        length_ = 0;
+    }
+#endif
+
+    static const std::size_t ALIGNMENT = 64;
+    static const std::size_t CHUNK_SLOTS = 4096; // Slots save() copies out at a time
+
+    const char * data_;
+    std::size_t length_;
+    hasher hashFunctions_;
+    const value_type * stash_;
+    const std::uint8_t * tags_;
+    const value_type * entries_;
+    std::size_t tableSize_;
+    std::size_t stashSize_;
+    std::size_t size_;
+};
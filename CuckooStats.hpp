@@ -0,0 +1,156 @@
+#pragma once
+#include <cstddef>
+#include <chrono>
+#include <ostream>
+
+// Statistics policies for CuckooHashTable. The table calls these hooks as it works; it keeps one
+// policy object per table and hands it out through CuckooHashTable::stats(). Hooks may be called
+// from const lookups, so a policy that's shared between threads has to synchronise itself.
+//
+// The default, NoCuckooStats, does nothing and never reads the clock, so it compiles away entirely
+
+struct NoCuckooStats
+{
+    typedef int Timer;
+
+    static Timer startTimer()
+    {
+        return 0;
+    }
+
+    void onInsert() { }
+    void onRemove() { }
+    void onEviction(std::size_t) { }
+    void onEvictionFailed() { }
+    void onStashInsert() { }
+    void onStashHit() { }
+    void onRehash(Timer) { }
+    void onResize(bool, Timer) { }
+
+    void writeJson(std::ostream & out) const
+    {
+        out << "null";
+    }
+};
+
+// Counts everything the hooks report and times rehashes and resizes
+struct CuckooStats
+{
+    typedef std::chrono::steady_clock::time_point Timer;
+
+    // One count per eviction chain length; the last bucket also holds every longer chain
+    static const std::size_t HISTOGRAM_SIZE = 16;
+
+    std::size_t inserts;
+    std::size_t removes;
+    std::size_t evictions;       // Insertions that had to move other elements to make room
+    std::size_t evictionMoves;   // Elements moved by those insertions
+    std::size_t evictionsFailed; // Insertions that couldn't make room and went to the stash or a rebuild
+    std::size_t evictionHistogram[HISTOGRAM_SIZE];
+    std::size_t stashInserts;
+    std::size_t stashHits;       // Lookups answered from the stash
+    std::size_t rehashes;        // Rebuilds at the same size with new hash functions
+    double rehashSeconds;
+    std::size_t grows;
+    double growSeconds;
+    std::size_t shrinks;
+    double shrinkSeconds;
+
+    CuckooStats()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        inserts = removes = 0;
+        evictions = evictionMoves = evictionsFailed = 0;
+        for (std::size_t i = 0; i < HISTOGRAM_SIZE; ++i)
+            evictionHistogram[i] = 0;
+        stashInserts = stashHits = 0;
+        rehashes = grows = shrinks = 0;
+        rehashSeconds = growSeconds = shrinkSeconds = 0;
+    }
+
+    static Timer startTimer()
+    {
+        return std::chrono::steady_clock::now();
+    }
+
+    void onInsert()
+    {
+        ++inserts;
+    }
+
+    void onRemove()
+    {
+        ++removes;
+    }
+
+    void onEviction(std::size_t moves)
+    {
+        ++evictions;
+        evictionMoves += moves;
+        ++evictionHistogram[moves < HISTOGRAM_SIZE ? moves : HISTOGRAM_SIZE - 1];
+    }
+
+    void onEvictionFailed()
+    {
+        ++evictionsFailed;
+    }
+
+    void onStashInsert()
+    {
+        ++stashInserts;
+    }
+
+    void onStashHit()
+    {
+        ++stashHits;
+    }
+
+    void onRehash(Timer start)
+    {
+        ++rehashes;
+        rehashSeconds += secondsSince(start);
+    }
+
+    // An incremental resize is only timed up to the point where the new arrays are in place
+    void onResize(bool grow, Timer start)
+    {
+        if (grow)
+        {
+            ++grows;
+            growSeconds += secondsSince(start);
+        }
+        else
+        {
+            ++shrinks;
+            shrinkSeconds += secondsSince(start);
+        }
+    }
+
+    void writeJson(std::ostream & out) const
+    {
+        out << "{\"inserts\":" << inserts
+            << ",\"removes\":" << removes
+            << ",\"evictions\":{\"count\":" << evictions
+            << ",\"moves\":" << evictionMoves
+            << ",\"failed\":" << evictionsFailed
+            << ",\"histogram\":[";
+        for (std::size_t i = 0; i < HISTOGRAM_SIZE; ++i)
+            out << (i == 0 ? "" : ",") << evictionHistogram[i];
+        out << "]},\"stash\":{\"inserts\":" << stashInserts
+            << ",\"hits\":" << stashHits
+            << "},\"rehashes\":{\"count\":" << rehashes << ",\"seconds\":" << rehashSeconds
+            << "},\"grows\":{\"count\":" << grows << ",\"seconds\":" << growSeconds
+            << "},\"shrinks\":{\"count\":" << shrinks << ",\"seconds\":" << shrinkSeconds
+            << "}}";
+    }
+
+private:
+    static double secondsSince(Timer start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
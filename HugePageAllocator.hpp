@@ -0,0 +1,141 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// Allocator for big, randomly accessed arrays such as CuckooHashTable's slots. With 4 KB pages
+// nearly every probe of a large table misses the TLB; backing the array with 2 MB pages lets the
+// TLB cover 512 times as much of it.
+//
+// On Linux, allocations of at least one huge page are mapped with MAP_HUGETLB if the system has
+// huge pages reserved, and otherwise mapped 2 MB-aligned and marked MADV_HUGEPAGE so transparent
+// huge pages can back them. Smaller allocations, and all allocations elsewhere, are just aligned to
+// a cache line, so a bucket never straddles two lines more than it has to
+template <typename T>
+class HugePageAllocator
+{
+public:
+    typedef T value_type;
+
+    HugePageAllocator()
+    {
+    }
+
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U> &)
+    {
+    }
+
+    T * allocate(std::size_t n)
+    {
+        if (n > (std::size_t)-1 / sizeof(T))
+            throw std::bad_alloc();
+
+        void * memory = allocateBytes(n * sizeof(T));
+        if (!memory)
+            throw std::bad_alloc();
+        return (T *)memory;
+    }
+
+    void deallocate(T * p, std::size_t n)
+    {
+        deallocateBytes(p, n * sizeof(T));
+    }
+
+private:
+#if defined(__linux__)
+    static void * allocateBytes(std::size_t bytes)
+    {
+        if (bytes < HUGE_PAGE_SIZE)
+            return allocateAligned(bytes);
+
+        std::size_t length = roundToHugePages(bytes);
+#ifdef MAP_HUGETLB
+        void * memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED)
+            return memory;
+#endif
+
+        // No reserved huge pages, so over-allocate and trim the mapping to a 2 MB boundary, which
+        // transparent huge pages need
+        char * mapping = (char *)mmap(nullptr, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == (char *)MAP_FAILED)
+            return nullptr;
+
+        std::size_t misalignment = (std::size_t)mapping % HUGE_PAGE_SIZE;
+        std::size_t head = misalignment == 0 ? 0 : HUGE_PAGE_SIZE - misalignment;
+        if (head > 0)
+            munmap(mapping, head);
+        munmap(mapping + head + length, HUGE_PAGE_SIZE - head);
+
+#ifdef MADV_HUGEPAGE
+        madvise(mapping + head, length, MADV_HUGEPAGE);
+#endif
+        return mapping + head;
+    }
+
+    static void deallocateBytes(void * p, std::size_t bytes)
+    {
+        if (bytes < HUGE_PAGE_SIZE)
+            deallocateAligned(p);
+        else
+            munmap(p, roundToHugePages(bytes));
+    }
+
+    static std::size_t roundToHugePages(std::size_t bytes)
+    {
+        return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+#else
+    static void * allocateBytes(std::size_t bytes)
+    {
+        return allocateAligned(bytes);
+    }
+
+    static void deallocateBytes(void * p, std::size_t)
+    {
+        deallocateAligned(p);
+    }
+#endif
+
+    static void * allocateAligned(std::size_t bytes)
+    {
+#if defined(_WIN32)
+        return _aligned_malloc(bytes == 0 ? 1 : bytes, CACHE_LINE_SIZE);
+#else
+        void * memory;
+        return posix_memalign(&memory, CACHE_LINE_SIZE, bytes == 0 ? 1 : bytes) == 0 ? memory : nullptr;
+#endif
+    }
+
+    static void deallocateAligned(void * p)
+    {
+#if defined(_WIN32)
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+
+    static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    static const std::size_t CACHE_LINE_SIZE = 64;
+};
+
+// All HugePageAllocators are interchangeable
+template <typename T, typename U>
+bool operator==(const HugePageAllocator<T> &, const HugePageAllocator<U> &)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const HugePageAllocator<T> &, const HugePageAllocator<U> &)
+{
+    return false;
+}
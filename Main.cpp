@@ -1,5 +1,18 @@
 #include <iostream>
+#include <cstddef>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <memory>
 #include "CuckooHashTable.hpp"
+#include "CuckooHashMap.hpp"
+#include "ConcurrentCuckooHashTable.hpp"
+#include "CuckooFilter.hpp"
+#include "ShardedCuckooHashTable.hpp"
+#include "CuckooSnapshot.hpp"
+#include "MurmurHash2.h"
 #include "BinaryHeap.hpp"
 
 struct SimpleStruct
@@ -33,6 +46,353 @@ void CuckooHashTest()
     }
 }
 
+void CuckooHashMapTest()
+{
+    CuckooHashMap<std::uint32_t, SimpleStruct> map(5);
+    map.try_emplace(1, SimpleStruct{ 1, 2, 3.0 });
+    map[2].x = 4;
+    map.insert_or_assign(1, SimpleStruct{ 5, 6, 7.0 });
+
+    std::cout << "map[1].x = " << map.find(1)->x << ", map[2].x = " << map.find(2)->x << std::endl;
+    std::cout << "Contains 3? " << map.contains(3) << std::endl;
+}
+
+void ConcurrentCuckooHashTest()
+{
+    // Starts small so the writers race through several resizes
+    ConcurrentCuckooHashTable<std::uint32_t> table(16);
+    const std::uint32_t perThread = 20000;
+    std::atomic<int> lost(0);
+
+    std::vector<std::thread> threads;
+    for (std::uint32_t t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&table, &lost, t, perThread]()
+        {
+            for (std::uint32_t i = 0; i < perThread; i++)
+            {
+                std::uint32_t x = t * perThread + i;
+                table.insert(x);
+                if (!table.contains(x) || !table.contains(t * perThread + i / 2))
+                    lost++;
+            }
+        });
+    }
+    for (auto & thread : threads)
+        thread.join();
+
+    std::uint32_t missing = 0;
+    for (std::uint32_t x = 0; x < 4 * perThread; x++)
+        missing += !table.contains(x);
+    std::cout << "Concurrent size = " << table.size() << ", missing " << missing << ", lost during inserts " << lost << std::endl;
+}
+
+void CuckooFilterTest()
+{
+    // Fill the filter until an insert is refused; the fingerprint that couldn't be placed is kept
+    // as the victim, so everything inserted up to then must still be found
+    CuckooFilter<std::uint32_t> filter(256);
+    std::uint32_t inserted = 0;
+    while (filter.insert(inserted))
+        inserted++;
+
+    std::uint32_t falseNegatives = 0;
+    for (std::uint32_t x = 0; x < inserted; x++)
+        falseNegatives += !filter.contains(x);
+    std::cout << "Filter full after " << inserted << " of " << filter.capacity() << ", size = " << filter.size()
+              << ", false negatives " << falseNegatives << std::endl;
+
+    // Removing an element makes room for the victim, after which inserts work again
+    filter.remove(0);
+    bool reinserted = filter.insert(0);
+    falseNegatives = 0;
+    for (std::uint32_t x = 0; x < inserted; x++)
+        falseNegatives += !filter.contains(x);
+    std::cout << "Reinserted after remove? " << reinserted << ", false negatives " << falseNegatives << std::endl;
+}
+
+void ShardedCuckooHashTest()
+{
+    ShardedCuckooHashTable<std::uint32_t> table(16, 8);
+    const std::uint32_t perThread = 10000;
+
+    // Each thread inserts half of its range one at a time and the other half as a batch
+    std::vector<std::thread> threads;
+    for (std::uint32_t t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&table, t, perThread]()
+        {
+            std::vector<std::uint32_t> batch;
+            for (std::uint32_t i = 0; i < perThread; i++)
+            {
+                if (i % 2 == 0)
+                    table.insert(t * perThread + i);
+                else
+                    batch.push_back(t * perThread + i);
+            }
+            table.insert_batch(batch.begin(), batch.end());
+        });
+    }
+    for (auto & thread : threads)
+        thread.join();
+
+    std::uint32_t missing = 0;
+    for (std::uint32_t x = 0; x < 4 * perThread; x++)
+    {
+        std::uint32_t found = 0;
+        if (!table.find(x, found) || found != x)
+            missing++;
+    }
+    std::size_t visited = 0;
+    table.forEach([&visited](std::uint32_t) { visited++; });
+    std::cout << "Sharded over " << table.shardCount() << " shards: size = " << table.size() << ", visited "
+              << visited << ", missing " << missing << std::endl;
+
+    for (std::uint32_t x = 0; x < 4 * perThread; x += 2)
+        table.remove(x);
+    std::cout << "After removing evens: size = " << table.size() << ", contains 2? " << table.contains(2)
+              << ", contains 3? " << table.contains(3) << std::endl;
+}
+
+void CuckooSnapshotTest()
+{
+    typedef CuckooHashTable<std::uint64_t> Table;
+    Table table;
+    for (std::uint64_t i = 0; i < 1000; i++)
+        table.insert(i * 3);
+
+    const char * path = "CuckooSnapshotTest.bin";
+    bool saved = CuckooSnapshot<Table>::save(table, path);
+    CuckooSnapshot<Table> snapshot;
+    bool opened = snapshot.open(path);
+
+    std::uint32_t wrong = 0;
+    for (std::uint64_t i = 0; i < 3000; i++)
+        wrong += snapshot.contains(i) != (i % 3 == 0);
+    std::cout << "Snapshot saved? " << saved << ", opened? " << opened << ", size = " << snapshot.size()
+              << ", wrong lookups " << wrong << std::endl;
+
+    // The checksum covers the header too, so a changed element count is caught
+    snapshot.close();
+    std::FILE * file = std::fopen(path, "r+b");
+    if (file)
+    {
+        std::uint64_t size = 999;
+        std::fseek(file, offsetof(CuckooSnapshotHeader, size), SEEK_SET);
+        std::fwrite(&size, sizeof(size), 1, file);
+        std::fclose(file);
+    }
+    std::cout << "Opened after corrupting the header? " << snapshot.open(path) << std::endl;
+    snapshot.close();
+    std::remove(path);
+}
+
+void StringKeyTest()
+{
+    // String keys can be looked up by C string without building a std::string
+    CuckooHashTable<std::string> strings;
+    strings.insert("apple");
+    strings.insert(std::string("banana"));
+    std::string banana("banana");
+    std::cout << "Contains \"apple\"? " << strings.contains("apple") << ", a copy of banana? " << strings.contains(banana)
+              << ", \"cherry\"? " << strings.contains("cherry") << std::endl;
+
+    CuckooHashMap<std::string, int> counts;
+    counts["one"] = 1;
+    counts["two"] = 2;
+    const char * two = "two";
+    std::cout << "counts[\"two\"] = " << *counts.find(two) << ", by a copy of the key = " << *counts.find(std::string(two))
+              << ", contains \"three\"? " << counts.contains("three") << std::endl;
+
+    // Keys that own memory are hashed by value, so an equal copy is found
+    CuckooHashTable<std::pair<std::string, int>> pairs;
+    pairs.insert(std::make_pair(std::string("pair"), 1));
+    CuckooHashTable<std::vector<std::string>> vectors;
+    vectors.insert(std::vector<std::string>{ "a", "b" });
+    std::cout << "Contains a copy of the pair? " << pairs.contains(std::make_pair(std::string("pair"), 1))
+              << ", of the vector? " << vectors.contains(std::vector<std::string>{ "a", "b" })
+              << ", (\"ab\")? " << vectors.contains(std::vector<std::string>{ "ab" }) << std::endl;
+}
+
+// Move-only element, keyed on id, whose destructor frees memory
+struct Widget
+{
+    int id;
+    std::unique_ptr<std::string> name;
+
+    Widget(int i, const std::string & n)
+        : id(i),
+          name(new std::string(n))
+    {
+    }
+};
+
+struct WidgetId
+{
+    const int & operator()(const Widget & widget) const
+    {
+        return widget.id;
+    }
+};
+
+void CuckooIteratorTest()
+{
+    CuckooHashTable<int> table;
+    for (int i = 0; i < 500; i++)
+        table.insert(i);
+
+    std::size_t count = 0;
+    long long sum = 0;
+    for (int x : table)
+    {
+        count++;
+        sum += x;
+    }
+    std::cout << "Iterated over " << count << " of " << table.size() << " elements, sum = " << sum << std::endl;
+
+    // Enough widgets to make the table grow, so they're moved between slots too
+    CuckooHashTable<Widget, CuckooHashFamily<int>, 4, 2, WidgetId> widgets(8);
+    for (int i = 0; i < 100; i++)
+        widgets.emplace(i, "widget " + std::to_string(i));
+    bool duplicate = widgets.emplace(7, "again");
+    const Widget * seven = widgets.find(7);
+    std::cout << "Emplaced duplicate? " << duplicate << ", widget 7 is \"" << (seven ? *seven->name : "") << "\"";
+
+    for (int i = 0; i < 100; i += 2)
+        widgets.remove(i);
+    std::cout << ", size after removing evens = " << widgets.size() << ", contains 7? " << widgets.contains(7)
+              << ", contains 8? " << widgets.contains(8) << std::endl;
+}
+
+void IncrementalResizeTest()
+{
+    CuckooHashTable<int> table(16);
+    table.setIncrementalResize(true);
+
+    // Removals are mixed in with the inserts, so some land while a resize is only partly migrated
+    const int count = 20000;
+    std::vector<bool> live(count, false);
+    std::size_t capacity = table.capacity();
+    int resizes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        table.insert(i);
+        live[i] = true;
+        if (i % 3 == 0)
+        {
+            table.remove(i / 2);
+            live[i / 2] = false;
+        }
+        if (table.capacity() != capacity)
+        {
+            capacity = table.capacity();
+            resizes++;
+        }
+    }
+
+    int wrong = 0;
+    for (int i = 0; i < count; i++)
+        wrong += table.contains(i) != live[i];
+    std::cout << "Incremental: " << resizes << " resizes, size = " << table.size() << ", wrong lookups " << wrong << std::endl;
+
+    // Emptying the table shrinks it back down, even if a migration was still going on
+    std::size_t grown = table.capacity();
+    for (int i = 0; i < count; i++)
+        table.remove(i);
+    std::cout << "Capacity " << grown << " when full, " << table.capacity() << " once emptied" << std::endl;
+}
+
+// Builds a table from keys with bulk_build on four threads and another with insert, and compares them
+template <typename Table>
+void compareBulkBuild(const std::vector<std::uint32_t> & keys, int hashFunctions)
+{
+    Table built;
+    built.bulk_build(keys.begin(), keys.end(), 4);
+
+    Table inserted;
+    for (std::uint32_t key : keys)
+        inserted.insert(key);
+
+    std::uint32_t wrong = 0;
+    for (std::uint32_t x = 0; x < 2 * keys.size(); x++)
+        wrong += built.contains(x) != inserted.contains(x);
+    std::cout << hashFunctions << " hash functions: bulk_build size = " << built.size() << ", insert size = "
+              << inserted.size() << ", lookups that differ " << wrong << std::endl;
+}
+
+void BulkBuildTest()
+{
+    // Big enough for bulk_build to go parallel, with some duplicates
+    std::vector<std::uint32_t> keys;
+    for (std::uint32_t i = 0; i < 100000; i++)
+        keys.push_back(i * 7 % 90000);
+
+    compareBulkBuild<CuckooHashTable<std::uint32_t>>(keys, 2);
+    compareBulkBuild<CuckooHashTable<std::uint32_t, CuckooHashFamily<std::uint32_t>, 4, 3>>(keys, 3);
+}
+
+void BatchTest()
+{
+    std::vector<std::uint64_t> keys;
+    for (std::uint64_t i = 0; i < 5000; i++)
+        keys.push_back(i * i % 4001);
+
+    CuckooHashTable<std::uint64_t> batched;
+    CuckooHashTable<std::uint64_t> single;
+    std::size_t batchInserted = batched.insert_batch(keys.begin(), keys.end());
+    std::size_t singleInserted = 0;
+    for (std::uint64_t key : keys)
+        singleInserted += single.insert(key);
+
+    std::vector<std::uint64_t> queries;
+    for (std::uint64_t x = 0; x < 8000; x++)
+        queries.push_back(x);
+    std::vector<char> found(queries.size());
+    batched.contains_batch(queries.begin(), queries.end(), found.begin());
+
+    std::size_t wrong = 0;
+    for (std::size_t i = 0; i < queries.size(); i++)
+        wrong += (found[i] != 0) != single.contains(queries[i]);
+    std::cout << "insert_batch inserted " << batchInserted << ", insert " << singleInserted
+              << ", contains_batch results that differ " << wrong << std::endl;
+}
+
+void CuckooStatsTest()
+{
+    // One slot per bucket, so inserts soon have to evict
+    CuckooHashTable<std::uint32_t, CuckooHashFamily<std::uint32_t>, 1, 2, CuckooIdentityKey, PrimeSizePolicy,
+                    std::allocator<std::uint32_t>, CuckooStats> table(16);
+    for (std::uint32_t i = 0; i < 2000; i++)
+        table.insert(i);
+    for (std::uint32_t i = 0; i < 1000; i++)
+        table.remove(i);
+
+    const CuckooStats & stats = table.stats();
+    std::cout << "Stats: inserts " << stats.inserts << ", removes " << stats.removes << ", evictions " << stats.evictions
+              << " moving " << stats.evictionMoves << " elements, grows " << stats.grows << ", shrinks " << stats.shrinks << std::endl;
+}
+
+void MurmurHash64x4Test()
+{
+    // Every tail length, with the four keys at different offsets into the same bytes. MurmurHash64
+    // reads whole words, so the offsets keep the keys 8-byte aligned
+    std::uint64_t words[16];
+    unsigned char * bytes = (unsigned char *)words;
+    for (int i = 0; i < 128; i++)
+        bytes[i] = (unsigned char)(i * 131 + 17);
+
+    int mismatches = 0;
+    for (int len = 0; len <= 40; len++)
+    {
+        const void * keys[4] = { bytes, bytes + 8, bytes + 24, bytes + 80 };
+        std::uint64_t out[4];
+        MurmurHash64x4(keys, len, 0x9747b28c, out);
+        for (int i = 0; i < 4; i++)
+            mismatches += out[i] != MurmurHash64(keys[i], len, 0x9747b28c);
+    }
+    std::cout << "MurmurHash64x4 hashes that differ from MurmurHash64: " << mismatches << std::endl;
+}
+
 void BinaryHeapTest()
 {
     std::vector<int> ints{ 3, 6, 9, 12, 8, 11 };
@@ -54,6 +414,18 @@ void BinaryHeapTest()
 int main(void)
 {    
     CuckooHashTest();
+    CuckooHashMapTest();
+    ConcurrentCuckooHashTest();
+    CuckooFilterTest();
+    ShardedCuckooHashTest();
+    CuckooSnapshotTest();
+    StringKeyTest();
+    CuckooIteratorTest();
+    IncrementalResizeTest();
+    BulkBuildTest();
+    BatchTest();
+    CuckooStatsTest();
+    MurmurHash64x4Test();
     BinaryHeapTest();
     std::cin.get();
     return 0;
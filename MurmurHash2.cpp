@@ -1,5 +1,14 @@
+#include <cstring>
 #include "MurmurHash2.h"
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MURMURHASH64X4_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 std::uint64_t MurmurHash64(const void * key, int len, unsigned int seed)
 {
     const uint64_t m = 0xc6a4a7935bd1e995;
@@ -42,3 +51,116 @@ std::uint64_t MurmurHash64(const void * key, int len, unsigned int seed)
 
     return h;
 }
+
+static void MurmurHash64x4Scalar(const void * const keys[4], int len, unsigned int seed, std::uint64_t out[4])
+{
+    for (int i = 0; i < 4; ++i)
+        out[i] = MurmurHash64(keys[i], len, seed);
+}
+
+#ifdef MURMURHASH64X4_AVX2
+#ifdef _MSC_VER
+#define MURMURHASH_TARGET_AVX2
+#else
+#define MURMURHASH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// AVX2 has no 64-bit multiply, so each lane is multiplied by m as
+// lo(k) * lo(m) + ((hi(k) * lo(m) + lo(k) * hi(m)) << 32)
+MURMURHASH_TARGET_AVX2
+static inline __m256i mulM(__m256i k, __m256i mLo, __m256i mHi)
+{
+    __m256i low = _mm256_mul_epu32(k, mLo);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(k, 32), mLo), _mm256_mul_epu32(k, mHi));
+    return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+static inline std::uint64_t load64(const void * p)
+{
+    std::uint64_t x;
+    std::memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+// The same steps as MurmurHash64, with one key in each 64-bit lane
+MURMURHASH_TARGET_AVX2
+static void MurmurHash64x4Avx2(const void * const keys[4], int len, unsigned int seed, std::uint64_t out[4])
+{
+    const uint64_t m = 0xc6a4a7935bd1e995;
+    const int r = 47;
+    const __m256i mLo = _mm256_set1_epi64x((long long)(m & 0xffffffff));
+    const __m256i mHi = _mm256_set1_epi64x((long long)(m >> 32));
+
+    const unsigned char * data0 = (const unsigned char *)keys[0];
+    const unsigned char * data1 = (const unsigned char *)keys[1];
+    const unsigned char * data2 = (const unsigned char *)keys[2];
+    const unsigned char * data3 = (const unsigned char *)keys[3];
+
+    __m256i h = _mm256_set1_epi64x((long long)(seed ^ (len * m)));
+
+    for (int offset = 0; offset < (len & ~7); offset += 8)
+    {
+        __m256i k = _mm256_set_epi64x((long long)load64(data3 + offset), (long long)load64(data2 + offset),
+                                      (long long)load64(data1 + offset), (long long)load64(data0 + offset));
+
+        k = mulM(k, mLo, mHi);
+        k = _mm256_xor_si256(k, _mm256_srli_epi64(k, r));
+        k = mulM(k, mLo, mHi);
+
+        h = _mm256_xor_si256(h, k);
+        h = mulM(h, mLo, mHi);
+    }
+
+    // The tail bytes, read little-endian like the switch in MurmurHash64
+    if (len & 7)
+    {
+        std::uint64_t tail[4] = { 0, 0, 0, 0 };
+        std::memcpy(&tail[0], data0 + (len & ~7), len & 7);
+        std::memcpy(&tail[1], data1 + (len & ~7), len & 7);
+        std::memcpy(&tail[2], data2 + (len & ~7), len & 7);
+        std::memcpy(&tail[3], data3 + (len & ~7), len & 7);
+
+        h = _mm256_xor_si256(h, _mm256_set_epi64x((long long)tail[3], (long long)tail[2], (long long)tail[1], (long long)tail[0]));
+        h = mulM(h, mLo, mHi);
+    }
+
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, r));
+    h = mulM(h, mLo, mHi);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, r));
+
+    _mm256_storeu_si256((__m256i *)out, h);
+}
+
+static bool cpuHasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    // AVX2 also needs the OS to save the YMM registers (OSXSAVE, and XCR0 bits 1 and 2)
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+void MurmurHash64x4(const void * const keys[4], int len, unsigned int seed, std::uint64_t out[4])
+{
+    typedef void (*Kernel)(const void * const keys[4], int len, unsigned int seed, std::uint64_t out[4]);
+
+#ifdef MURMURHASH64X4_AVX2
+    static const Kernel kernel = cpuHasAvx2() ? MurmurHash64x4Avx2 : MurmurHash64x4Scalar;
+#else
+    static const Kernel kernel = MurmurHash64x4Scalar;
+#endif
+
+    kernel(keys, len, seed, out);
+}
@@ -1,4 +1,8 @@
 #pragma once
 #include <cstdint>
 
-std::uint64_t MurmurHash64(const void * key, int len, unsigned int seed);
\ No newline at end of file
+std::uint64_t MurmurHash64(const void * key, int len, unsigned int seed);
+
+// Hashes four keys of the same length at once, writing MurmurHash64(keys[i], len, seed) to out[i].
+// Uses AVX2 when the CPU has it, with a key in each 64-bit lane, and otherwise hashes them one by one
+void MurmurHash64x4(const void * const keys[4], int len, unsigned int seed, std::uint64_t out[4]);
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "MurmurHash3.h"
+
+// MurmurHash3 (See https://github.com/aappleby/smhasher, MurmurHash3.cpp)
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccd;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53;
+    k ^= k >> 33;
+
+    return k;
+}
+
+void MurmurHash3_x64_128(const void * key, int len, std::uint32_t seed, std::uint64_t out[2])
+{
+    const unsigned char * data = (const unsigned char *)key;
+    const int nblocks = len / 16;
+
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+
+    const uint64_t c1 = 0x87c37b91114253d5;
+    const uint64_t c2 = 0x4cf5ad432745937f;
+
+    const uint64_t * blocks = (const uint64_t *)data;
+
+    for (int i = 0; i < nblocks; i++)
+    {
+        uint64_t k1 = blocks[i * 2];
+        uint64_t k2 = blocks[i * 2 + 1];
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const unsigned char * tail = data + nblocks * 16;
+
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    // The tail bytes, read little-endian as in the reference switch: bytes 8..14 into k2 and 0..7 into k1.
+    // Written as loops so there is no case fallthrough to annotate
+    const int rest = len & 15;
+
+    for (int i = rest - 1; i >= 8; --i)
+        k2 ^= uint64_t(tail[i]) << ((i - 8) * 8);
+    if (rest > 8)
+    {
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+
+    for (int i = (rest < 8 ? rest : 8) - 1; i >= 0; --i)
+        k1 ^= uint64_t(tail[i]) << (i * 8);
+    if (rest > 0)
+    {
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= (uint64_t)len;
+    h2 ^= (uint64_t)len;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    out[0] = h1;
+    out[1] = h2;
+}
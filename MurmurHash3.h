@@ -0,0 +1,4 @@
+#pragma once
+#include <cstdint>
+
+void MurmurHash3_x64_128(const void * key, int len, std::uint32_t seed, std::uint64_t out[2]);
@@ -0,0 +1,224 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "CuckooHashTable.hpp"
+
+// Thread-safe cuckoo hash set made of independent CuckooHashTable shards, each behind its own mutex.
+// The top bits of a separate routing hash pick a key's shard, so operations on keys in different
+// shards never contend, and a shard that has to grow, shrink or rehash only blocks the keys routed
+// to it. Simpler than ConcurrentCuckooHashTable and takes any element type, but lookups lock too, so
+// it suits write-heavy workloads spread over many threads better than read-mostly ones.
+//
+// The routing hash comes from a HashFamily of its own, with seeds independent of the shards' hash
+// functions, so every shard still sees well-spread hashes. The template parameters are passed on
+// to each shard's CuckooHashTable
+template<typename AnyType, typename HashFamily = CuckooHashFamily<AnyType>, std::size_t BucketSize = 4,
+         std::size_t NumHashFunctions = 2, typename KeyOfValue = CuckooIdentityKey,
+         typename SizePolicy = PrimeSizePolicy, typename Allocator = std::allocator<AnyType>,
+         typename StatsPolicy = NoCuckooStats>
+class ShardedCuckooHashTable
+{
+public:
+    typedef CuckooHashTable<AnyType, HashFamily, BucketSize, NumHashFunctions, KeyOfValue, SizePolicy,
+                            Allocator, StatsPolicy> Table;
+    typedef typename Table::key_type key_type;
+    typedef AnyType value_type;
+
+    // size is the number of slots requested per table across all the shards. shards is rounded up to
+    // a power of two; 0 picks four shards per hardware thread, so that threads rarely collide
+    explicit ShardedCuckooHashTable(std::size_t size = 101, std::size_t shards = 0)
+        : shardBits_(0)
+    {
+        if (shards == 0)
+            shards = 4 * std::max(1u, std::thread::hardware_concurrency());
+        while (((std::size_t)1 << shardBits_) < shards)
+            ++shardBits_;
+
+        std::size_t shardSize = std::max<std::size_t>(size >> shardBits_, BucketSize);
+        for (std::size_t i = 0; i < ((std::size_t)1 << shardBits_); ++i)
+            shards_.emplace_back(new Shard(shardSize));
+    }
+
+    ShardedCuckooHashTable(const ShardedCuckooHashTable &) = delete;
+    ShardedCuckooHashTable & operator=(const ShardedCuckooHashTable &) = delete;
+
+    std::size_t shardCount() const
+    {
+        return shards_.size();
+    }
+
+    // Locks each shard in turn, so the total is only exact if no other thread is changing the table
+    std::size_t size() const
+    {
+        std::size_t total = 0;
+        for (const auto & shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->table.size();
+        }
+        return total;
+    }
+
+    void makeEmpty()
+    {
+        for (auto & shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->table.makeEmpty();
+        }
+    }
+
+    bool contains(const key_type & x) const
+    {
+        const Shard & shard = shardFor(x);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.table.contains(x);
+    }
+
+    // Copies the element with the given key to out and returns true, or returns false if there isn't
+    // one. Pointers into a shard can't be handed out, since another thread may move the element
+    bool find(const key_type & x, AnyType & out) const
+    {
+        const Shard & shard = shardFor(x);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const AnyType * element = shard.table.find(x);
+        if (!element)
+            return false;
+
+        out = *element;
+        return true;
+    }
+
+    // Calls visitor with the element with the given key, if there is one, while its shard is locked,
+    // and returns whether it did. visitor may change the element, but not its key, and mustn't use
+    // the table
+    template <typename Visitor>
+    bool visit(const key_type & x, Visitor visitor)
+    {
+        Shard & shard = shardFor(x);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        AnyType * element = shard.table.find(x);
+        if (!element)
+            return false;
+
+        visitor(*element);
+        return true;
+    }
+
+    bool insert(const AnyType & x)
+    {
+        Shard & shard = shardFor(KeyOfValue()(x));
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.table.insert(x);
+    }
+
+    bool insert(AnyType && x)
+    {
+        Shard & shard = shardFor(KeyOfValue()(x));
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.table.insert(std::move(x));
+    }
+
+    // The element is built before its shard is locked, since its key is needed to pick the shard
+    template <typename... Args>
+    bool emplace(Args &&... args)
+    {
+        return insert(AnyType(std::forward<Args>(args)...));
+    }
+
+    bool remove(const key_type & x)
+    {
+        Shard & shard = shardFor(x);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.table.remove(x);
+    }
+
+    // Inserts every element of [first, last), returning the number that weren't already in the table.
+    // The elements are grouped by shard first, so each shard is locked only once
+    template <typename ForwardIt>
+    std::size_t insert_batch(ForwardIt first, ForwardIt last)
+    {
+        std::vector<std::vector<AnyType>> groups(shards_.size());
+        for (; first != last; ++first)
+            groups[shardIndex(KeyOfValue()(*first))].push_back(*first);
+
+        std::size_t inserted = 0;
+        for (std::size_t i = 0; i < groups.size(); ++i)
+        {
+            if (groups[i].empty())
+                continue;
+
+            std::lock_guard<std::mutex> lock(shards_[i]->mutex);
+            inserted += shards_[i]->table.insert_batch(groups[i].begin(), groups[i].end());
+        }
+        return inserted;
+    }
+
+    // Calls function with every element, locking one shard at a time. function mustn't use the table
+    template <typename Function>
+    void forEach(Function function) const
+    {
+        for (const auto & shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            for (const AnyType & element : shard->table)
+                function(element);
+        }
+    }
+
+    // Each shard's CuckooHashTable::statsJson(), as a JSON array
+    std::string statsJson() const
+    {
+        std::ostringstream out;
+        out << "[";
+        for (std::size_t i = 0; i < shards_.size(); ++i)
+        {
+            std::lock_guard<std::mutex> lock(shards_[i]->mutex);
+            out << (i == 0 ? "" : ",") << shards_[i]->table.statsJson();
+        }
+        out << "]";
+        return out.str();
+    }
+
+private:
+    // Each shard is a separate allocation, and its table already spans several cache lines, so
+    // neighbouring shards' mutexes don't end up sharing a line
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        Table table;
+
+        explicit Shard(std::size_t size)
+            : table(size) { }
+    };
+
+    template <typename K>
+    std::size_t shardIndex(const K & x) const
+    {
+        return shardBits_ == 0 ? 0 : (std::size_t)(router_.hash(x, 0) >> (64 - shardBits_));
+    }
+
+    template <typename K>
+    Shard & shardFor(const K & x)
+    {
+        return *shards_[shardIndex(x)];
+    }
+
+    template <typename K>
+    const Shard & shardFor(const K & x) const
+    {
+        return *shards_[shardIndex(x)];
+    }
+
+    unsigned shardBits_; // log2 of the number of shards
+    std::vector<std::unique_ptr<Shard>> shards_;
+    HashFamily router_;  // Picks each key's shard
+};